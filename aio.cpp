@@ -0,0 +1,419 @@
+/*
+* AsyncIO - see aio.h
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if !defined(_WIN32)
+    #include <unistd.h>
+#endif
+#if defined(__linux__)
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+#endif
+#include "aio.h"
+
+/*
+* the rings shared with the kernel, as described in io_uring_setup(2).
+* the kernel moves the submission queue's head and the completion queue's tail;
+* we move the other two.
+*/
+struct AsyncIO::Ring
+{
+    int fd;
+    unsigned entries;
+    unsigned inflight;
+    unsigned* sqhead;
+    unsigned* sqtail;
+    unsigned* sqmask;
+    unsigned* sqarray;
+    unsigned* cqhead;
+    unsigned* cqtail;
+    unsigned* cqmask;
+    #if defined(__linux__)
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    #endif
+    void* sqmap;
+    size_t sqmaplen;
+    void* cqmap;
+    size_t cqmaplen;
+    size_t sqeslen;
+};
+
+AsyncIO::AsyncIO(unsigned depth): m_ring(nullptr), m_threaded(false), m_stopping(false)
+{
+    const char* env;
+    env = std::getenv("RMCPP_IO");
+    if((env == nullptr) || (std::strcmp(env, "thread") != 0))
+    {
+        setupring(depth);
+    }
+    #if !defined(_WIN32)
+    m_threaded = (m_ring == nullptr);
+    #endif
+}
+
+AsyncIO::~AsyncIO()
+{
+    if(m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stopping = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    closering();
+}
+
+bool AsyncIO::setupring(unsigned entries)
+{
+    #if defined(__linux__)
+    int fd;
+    void* sqes;
+    Ring* ring;
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if(fd < 0)
+    {
+        return false;
+    }
+    ring = new Ring;
+    std::memset(ring, 0, sizeof(*ring));
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqmaplen = (params.sq_off.array + (params.sq_entries * sizeof(unsigned)));
+    ring->cqmaplen = (params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe)));
+    // since 5.4, both rings live in one mapping
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sqmaplen = std::max(ring->sqmaplen, ring->cqmaplen);
+        ring->cqmaplen = ring->sqmaplen;
+    }
+    ring->sqmap = mmap(nullptr, ring->sqmaplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(ring->sqmap == MAP_FAILED)
+    {
+        ::close(fd);
+        delete ring;
+        return false;
+    }
+    ring->cqmap = ring->sqmap;
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ring->cqmap = mmap(nullptr, ring->cqmaplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqeslen = (params.sq_entries * sizeof(struct io_uring_sqe));
+    sqes = mmap(nullptr, ring->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if((ring->cqmap == MAP_FAILED) || (sqes == MAP_FAILED))
+    {
+        if(sqes != MAP_FAILED)
+        {
+            munmap(sqes, ring->sqeslen);
+        }
+        if((ring->cqmap != MAP_FAILED) && (ring->cqmap != ring->sqmap))
+        {
+            munmap(ring->cqmap, ring->cqmaplen);
+        }
+        munmap(ring->sqmap, ring->sqmaplen);
+        ::close(fd);
+        delete ring;
+        return false;
+    }
+    ring->sqes = (struct io_uring_sqe*)sqes;
+    ring->sqhead = (unsigned*)((char*)ring->sqmap + params.sq_off.head);
+    ring->sqtail = (unsigned*)((char*)ring->sqmap + params.sq_off.tail);
+    ring->sqmask = (unsigned*)((char*)ring->sqmap + params.sq_off.ring_mask);
+    ring->sqarray = (unsigned*)((char*)ring->sqmap + params.sq_off.array);
+    ring->cqhead = (unsigned*)((char*)ring->cqmap + params.cq_off.head);
+    ring->cqtail = (unsigned*)((char*)ring->cqmap + params.cq_off.tail);
+    ring->cqmask = (unsigned*)((char*)ring->cqmap + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)((char*)ring->cqmap + params.cq_off.cqes);
+    m_ring = ring;
+    return true;
+    #else
+    (void)entries;
+    return false;
+    #endif
+}
+
+void AsyncIO::closering()
+{
+    #if defined(__linux__)
+    if(m_ring == nullptr)
+    {
+        return;
+    }
+    munmap(m_ring->sqes, m_ring->sqeslen);
+    if(m_ring->cqmap != m_ring->sqmap)
+    {
+        munmap(m_ring->cqmap, m_ring->cqmaplen);
+    }
+    munmap(m_ring->sqmap, m_ring->sqmaplen);
+    ::close(m_ring->fd);
+    delete m_ring;
+    m_ring = nullptr;
+    #endif
+}
+
+/*
+* an entry only counts as in flight once the kernel has taken it off the submission
+* queue. if io_uring_enter() fails before that, it is taken back out again - which is
+* safe, since this thread is the only one that ever submits anything.
+*/
+bool AsyncIO::ringsubmit(Request* req)
+{
+    #if defined(__linux__)
+    long rc;
+    unsigned tail;
+    unsigned idx;
+    unsigned head;
+    struct io_uring_sqe* sqe;
+    // never more in flight than there are entries, so the completion queue can't overflow
+    while(m_ring->inflight >= m_ring->entries)
+    {
+        ringreap(true);
+    }
+    tail = *m_ring->sqtail;
+    idx = (tail & *m_ring->sqmask);
+    sqe = &m_ring->sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    // whatever is left of it; see ringreap()
+    req->iov.iov_base = (req->data + req->done);
+    req->iov.iov_len = (req->size - req->done);
+    sqe->opcode = (req->write ? IORING_OP_WRITEV : IORING_OP_READV);
+    sqe->fd = req->fd;
+    sqe->addr = uint64_t(uintptr_t(&req->iov));
+    sqe->len = 1;
+    sqe->off = (req->offset + req->done);
+    sqe->user_data = uint64_t(uintptr_t(req));
+    m_ring->sqarray[idx] = idx;
+    __atomic_store_n(m_ring->sqtail, tail + 1, __ATOMIC_RELEASE);
+    do
+    {
+        rc = syscall(__NR_io_uring_enter, m_ring->fd, 1, 0, 0, nullptr, 0);
+    } while((rc == -1) && (errno == EINTR));
+    if(rc != 1)
+    {
+        head = __atomic_load_n(m_ring->sqhead, __ATOMIC_ACQUIRE);
+        if(head == tail)
+        {
+            // still sitting in the queue, so the next io_uring_enter() would submit it
+            __atomic_store_n(m_ring->sqtail, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        // taken after all, so it will complete like any other
+    }
+    m_ring->inflight++;
+    return true;
+    #else
+    (void)req;
+    return false;
+    #endif
+}
+
+/*
+* collects whatever has completed, waiting for at least one completion if <block> is true
+* (and anything is in flight at all). never submits anything itself; what needs to go
+* again is queued in m_again, for ringresubmit().
+*/
+void AsyncIO::ringreap(bool block)
+{
+    #if defined(__linux__)
+    int res;
+    unsigned head;
+    unsigned tail;
+    Request* req;
+    head = *m_ring->cqhead;
+    tail = __atomic_load_n(m_ring->cqtail, __ATOMIC_ACQUIRE);
+    if((head == tail) && block && (m_ring->inflight > 0))
+    {
+        syscall(__NR_io_uring_enter, m_ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        tail = __atomic_load_n(m_ring->cqtail, __ATOMIC_ACQUIRE);
+    }
+    while(head != tail)
+    {
+        const struct io_uring_cqe& cqe = m_ring->cqes[head & *m_ring->cqmask];
+        req = (Request*)uintptr_t(cqe.user_data);
+        res = cqe.res;
+        head++;
+        m_ring->inflight--;
+        if(res < 0)
+        {
+            if((res == -EINTR) || (res == -EAGAIN))
+            {
+                m_again.push_back(req);
+            }
+            else
+            {
+                req->error = -res;
+                req->finished = true;
+            }
+            continue;
+        }
+        req->done += size_t(res);
+        if(req->done == req->size)
+        {
+            req->finished = true;
+        }
+        else if(res == 0)
+        {
+            // a read at the end of the file is fine; a write that goes nowhere is not
+            if(req->write)
+            {
+                req->error = EIO;
+            }
+            req->finished = true;
+        }
+        else
+        {
+            m_again.push_back(req);
+        }
+    }
+    __atomic_store_n(m_ring->cqhead, head, __ATOMIC_RELEASE);
+    #else
+    (void)block;
+    #endif
+}
+
+// submits what ringreap() queued in m_again. whatever can't be submitted fails with EIO
+void AsyncIO::ringresubmit()
+{
+    Request* req;
+    while(!m_again.empty())
+    {
+        req = m_again.front();
+        m_again.pop_front();
+        if(!ringsubmit(req))
+        {
+            req->error = EIO;
+            req->finished = true;
+        }
+    }
+}
+
+void AsyncIO::threadloop()
+{
+    #if !defined(_WIN32)
+    long rc;
+    Request* req;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cond.wait(lock, [&]
+            {
+                return (m_stopping || !m_queue.empty());
+            });
+            if(m_queue.empty())
+            {
+                return;
+            }
+            req = m_queue.front();
+            m_queue.pop_front();
+        }
+        while(req->done < req->size)
+        {
+            if(req->write)
+            {
+                rc = pwrite(req->fd, req->data + req->done, req->size - req->done, req->offset + req->done);
+            }
+            else
+            {
+                rc = pread(req->fd, req->data + req->done, req->size - req->done, req->offset + req->done);
+            }
+            if(rc == -1)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                req->error = errno;
+                break;
+            }
+            if(rc == 0)
+            {
+                if(req->write)
+                {
+                    req->error = EIO;
+                }
+                break;
+            }
+            req->done += size_t(rc);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            req->finished = true;
+        }
+        m_cond.notify_all();
+    }
+    #endif
+}
+
+bool AsyncIO::submit(Request* req)
+{
+    req->done = 0;
+    req->error = 0;
+    req->finished = false;
+    if(m_ring != nullptr)
+    {
+        ringresubmit();
+        return ringsubmit(req);
+    }
+    if(!m_threaded)
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if(!m_thread.joinable())
+        {
+            m_thread = std::thread(&AsyncIO::threadloop, this);
+        }
+        m_queue.push_back(req);
+    }
+    m_cond.notify_all();
+    return true;
+}
+
+void AsyncIO::wait(Request* req)
+{
+    if(m_ring != nullptr)
+    {
+        while(true)
+        {
+            // first, so that <req> itself isn't waited for while it's sitting in m_again
+            ringresubmit();
+            if(req->finished)
+            {
+                break;
+            }
+            ringreap(true);
+        }
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cond.wait(lock, [&]
+    {
+        return req->finished;
+    });
+}
+
+const char* AsyncIO::backend() const
+{
+    if(m_ring != nullptr)
+    {
+        return "io_uring";
+    }
+    if(m_threaded)
+    {
+        return "thread";
+    }
+    return "none";
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#if !defined(_WIN32)
+    #include <sys/uio.h>
+#endif
+#include "rmcpp.h"
+
+/*
+* reads and writes whole buffers in the background, so that BatchRunner can strip one
+* file while the next is being read, and the last is being written.
+*
+* on Linux, requests go through io_uring (set up with raw system calls; there's no
+* need for liburing). where that's not available - older kernels, or a seccomp filter
+* that blocks it - a thread does the same with pread()/pwrite(). RMCPP_IO=thread forces
+* the latter. on Windows, nothing is supported, and submit() always fails.
+*
+* one instance is meant to be used by one thread only.
+*/
+class AsyncIO
+{
+    public:
+        /*
+        * one read or write of [data, data+size) at <offset> in <fd>.
+        * short reads and writes are continued until the request is complete; a read
+        * also ends at the end of the file. the request must stay where it is until wait()
+        * has returned for it.
+        */
+        struct Request
+        {
+            int fd = -1;
+            bool write = false;
+            char* data = nullptr;
+            size_t size = 0;
+            uint64_t offset = 0;
+
+            // filled in once finished: bytes transferred, and errno (0 if none)
+            size_t done = 0;
+            int error = 0;
+            bool finished = false;
+
+            #if !defined(_WIN32)
+            // what io_uring is pointed to
+            struct iovec iov;
+            #endif
+        };
+
+    private:
+        // io_uring state; see aio.cpp. null if not in use
+        struct Ring;
+        Ring* m_ring;
+        // requests that ringreap() found only partly done (or interrupted), to be submitted again
+        std::deque<Request*> m_again;
+
+        // the fallback thread, started on first use, and its queue
+        bool m_threaded;
+        std::thread m_thread;
+        std::mutex m_mtx;
+        std::condition_variable m_cond;
+        std::deque<Request*> m_queue;
+        bool m_stopping;
+
+    private:
+        bool setupring(unsigned entries);
+        void closering();
+        bool ringsubmit(Request* req);
+        void ringreap(bool block);
+        void ringresubmit();
+        void threadloop();
+
+    public:
+        // <depth> is how many requests may be in flight at once
+        AsyncIO(unsigned depth=16);
+        ~AsyncIO();
+
+        AsyncIO(const AsyncIO&) = delete;
+        AsyncIO& operator=(const AsyncIO&) = delete;
+
+        /**
+        * starts <req>.
+        * @returns false if it couldn't be started at all (in which case it never finishes).
+        */
+        bool submit(Request* req);
+
+        // blocks until <req> is finished
+        void wait(Request* req);
+
+        // @returns "io_uring", "thread", or "none"
+        const char* backend() const;
+};
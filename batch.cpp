@@ -0,0 +1,479 @@
+/*
+* BatchRunner - see batch.h
+*/
+
+#include <filesystem>
+#include <sstream>
+#include <thread>
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#include "batch.h"
+
+BatchRunner::BatchRunner(const CommentStripper::Options& opts, size_t nthreads): m_opts(opts), m_nthreads(nthreads), m_cache(nullptr)
+{
+    if(m_nthreads == 0)
+    {
+        m_nthreads = std::thread::hardware_concurrency();
+        if(m_nthreads == 0)
+        {
+            m_nthreads = 1;
+        }
+    }
+}
+
+void BatchRunner::add(const std::string& inpath, const std::string& outpath)
+{
+    Job job;
+    std::error_code ec;
+    job.index = m_jobs.size();
+    job.inpath = inpath;
+    job.outpath = outpath;
+    // unreadable files sort last; runjob() reports them
+    job.size = std::filesystem::file_size(inpath, ec);
+    if(ec)
+    {
+        job.size = 0;
+    }
+    m_jobs.push_back(job);
+}
+
+void BatchRunner::setCache(ResultCache* cache)
+{
+    m_cache = cache;
+}
+
+void BatchRunner::addto(const std::string& inpath, const std::string& outdir)
+{
+    std::filesystem::path rel;
+    std::filesystem::path dest;
+    rel = std::filesystem::path(inpath).lexically_normal().relative_path();
+    dest = outdir;
+    for(auto& part: rel)
+    {
+        if(part != "..")
+        {
+            dest /= part;
+        }
+    }
+    add(inpath, dest.string());
+}
+
+bool BatchRunner::addlist(const std::string& listpath, const std::string& outdir)
+{
+    size_t tab;
+    size_t lineno;
+    std::string line;
+    std::ifstream ifs(listpath, std::ios::in | std::ios::binary);
+    if(!ifs.good())
+    {
+        Util::error(RMCPP_FMT("cannot open list file %q for reading"), listpath);
+        return false;
+    }
+    lineno = 0;
+    while(std::getline(ifs, line))
+    {
+        lineno++;
+        if(!line.empty() && (line.back() == '\r'))
+        {
+            line.pop_back();
+        }
+        if(line.empty())
+        {
+            continue;
+        }
+        tab = line.find('\t');
+        if(tab != std::string::npos)
+        {
+            add(line.substr(0, tab), line.substr(tab + 1));
+        }
+        else if(outdir.empty())
+        {
+            Util::error(RMCPP_FMT("%s:%d: no output file for %q, and no output directory given"), listpath, lineno, line);
+            return false;
+        }
+        else
+        {
+            addto(line, outdir);
+        }
+    }
+    return true;
+}
+
+bool BatchRunner::take(size_t self, Job& dest)
+{
+    size_t i;
+    size_t victim;
+    // own queue first ...
+    {
+        std::lock_guard<std::mutex> lock(m_queues[self].mtx);
+        if(!m_queues[self].jobs.empty())
+        {
+            dest = m_queues[self].jobs.front();
+            m_queues[self].jobs.pop_front();
+            return true;
+        }
+    }
+    /*
+    * ... then steal from the others.
+    * this takes from the front, rather than the back (as is traditional for
+    * work-stealing), since the front holds the largest job left in that queue,
+    * and starting large jobs early is the whole point.
+    */
+    for(i=1; i<m_queues.size(); i++)
+    {
+        victim = ((self + i) % m_queues.size());
+        std::lock_guard<std::mutex> lock(m_queues[victim].mtx);
+        if(!m_queues[victim].jobs.empty())
+        {
+            dest = m_queues[victim].jobs.front();
+            m_queues[victim].jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void BatchRunner::work(size_t self)
+{
+    size_t cur;
+    bool more;
+    Job job;
+    Staged slots[3];
+    #if defined(_WIN32)
+    (void)cur;
+    (void)more;
+    (void)slots;
+    while(take(self, job))
+    {
+        runjob(job, m_results[job.index]);
+    }
+    #else
+    if(m_cache != nullptr)
+    {
+        while(take(self, job))
+        {
+            runjob(job, m_results[job.index]);
+        }
+        return;
+    }
+    /*
+    * three slots, used in turn: while the current one is stripped, the next one
+    * is being read, and the one before is being written.
+    * before a slot is reused for reading, its write has to be done.
+    */
+    AsyncIO aio;
+    more = take(self, job);
+    if(more)
+    {
+        stage(aio, job, slots[0]);
+    }
+    cur = 0;
+    while(slots[cur].busy)
+    {
+        Staged& next = slots[(cur + 1) % 3];
+        finish(aio, next);
+        if(more && take(self, job))
+        {
+            stage(aio, job, next);
+        }
+        else
+        {
+            more = false;
+        }
+        process(aio, slots[cur]);
+        cur = ((cur + 1) % 3);
+    }
+    for(auto& slot: slots)
+    {
+        finish(aio, slot);
+    }
+    #endif
+}
+
+void BatchRunner::runjob(const Job& job, Result& res)
+{
+    std::ostringstream msgs;
+    MappedFile inmap;
+    SpanWriter out;
+    CommentStripper::Options opts;
+    res.ok = false;
+    opts = m_opts;
+    opts.infilename = job.inpath;
+    if(!inmap.open(job.inpath))
+    {
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: cannot open %q for reading\n"), job.inpath);
+        res.messages = msgs.str();
+        return;
+    }
+    if(!prepareout(job, msgs))
+    {
+        res.messages = msgs.str();
+        return;
+    }
+    if(!out.open(job.outpath))
+    {
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: cannot open %q for writing\n"), job.outpath);
+        res.messages = msgs.str();
+        return;
+    }
+    if((m_cache != nullptr) && !opts.use_debugmessages)
+    {
+        // same as in main(): only results without any messages are cached
+        std::string key;
+        std::string captured;
+        ResultCache::FetchResult fetched;
+        key = ResultCache::makekey(opts, inmap.data(), inmap.size());
+        fetched = m_cache->fetch(key, out, nullptr);
+        if(fetched != ResultCache::FR_MISS)
+        {
+            res.ok = ((fetched == ResultCache::FR_HIT) && out.flush());
+        }
+        else
+        {
+            {
+                SpanWriter capout(captured);
+                CommentStripper cs(opts, inmap.data(), inmap.size());
+                cs.setDiagStream(&msgs);
+                res.ok = cs.run(capout);
+            }
+            out.span(captured.data(), captured.size());
+            res.ok = (out.flush() && res.ok);
+            if(res.ok && (msgs.tellp() == 0))
+            {
+                m_cache->store(key, captured, nullptr);
+            }
+        }
+    }
+    else if((inmap.fd() != -1) && !opts.use_debugmessages && CommentStripper::isverbatim(opts, inmap.data(), inmap.size()))
+    {
+        // same as in main(): nothing to strip, so it's copied as-is
+        res.ok = out.copyfrom(inmap.fd(), inmap.size());
+    }
+    else
+    {
+        CommentStripper cs(opts, inmap.data(), inmap.size());
+        cs.setDiagStream(&msgs);
+        res.ok = cs.run(out);
+    }
+    if(!out.good())
+    {
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: failed to write %q\n"), job.outpath);
+    }
+    res.messages = msgs.str();
+}
+
+bool BatchRunner::prepareout(const Job& job, std::ostream& msgs)
+{
+    std::error_code ec;
+    std::filesystem::path outpath;
+    outpath = job.outpath;
+    if(outpath.has_parent_path())
+    {
+        std::filesystem::create_directories(outpath.parent_path(), ec);
+    }
+    /* same as in main(): do not clobber the input file */
+    if(std::filesystem::exists(outpath, ec) && std::filesystem::equivalent(job.inpath, outpath, ec))
+    {
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: outputfile %q is also inputfile!\n"), job.outpath);
+        return false;
+    }
+    return true;
+}
+
+void BatchRunner::stage(AsyncIO& aio, const Job& job, Staged& slot)
+{
+    slot.job = job;
+    slot.busy = true;
+    slot.async = false;
+    slot.writing = false;
+    #if !defined(_WIN32)
+    // empty (or unreadable) and large files go the usual way
+    if((job.size == 0) || (job.size > maxstaged))
+    {
+        return;
+    }
+    slot.infd = ::open(job.inpath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(slot.infd == -1)
+    {
+        return;
+    }
+    if(slot.capacity < job.size)
+    {
+        slot.input.reset(new char[job.size]);
+        slot.capacity = job.size;
+    }
+    slot.rdreq.fd = slot.infd;
+    slot.rdreq.write = false;
+    slot.rdreq.data = slot.input.get();
+    slot.rdreq.size = size_t(job.size);
+    slot.rdreq.offset = 0;
+    if(!aio.submit(&slot.rdreq))
+    {
+        ::close(slot.infd);
+        slot.infd = -1;
+        return;
+    }
+    slot.async = true;
+    #else
+    (void)aio;
+    #endif
+}
+
+void BatchRunner::process(AsyncIO& aio, Staged& slot)
+{
+    std::ostringstream msgs;
+    CommentStripper::Options opts;
+    Result& res = m_results[slot.job.index];
+    if(!slot.async)
+    {
+        runjob(slot.job, res);
+        slot.busy = false;
+        return;
+    }
+    #if !defined(_WIN32)
+    res.ok = false;
+    aio.wait(&slot.rdreq);
+    ::close(slot.infd);
+    slot.infd = -1;
+    slot.busy = false;
+    if(slot.rdreq.error != 0)
+    {
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: cannot open %q for reading\n"), slot.job.inpath);
+        res.messages = msgs.str();
+        return;
+    }
+    if(!prepareout(slot.job, msgs))
+    {
+        res.messages = msgs.str();
+        return;
+    }
+    slot.outfd = ::open(slot.job.outpath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(slot.outfd == -1)
+    {
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: cannot open %q for writing\n"), slot.job.outpath);
+        res.messages = msgs.str();
+        return;
+    }
+    opts = m_opts;
+    opts.infilename = slot.job.inpath;
+    slot.output.clear();
+    slot.wrreq.fd = slot.outfd;
+    slot.wrreq.write = true;
+    slot.wrreq.offset = 0;
+    // the file may have shrunk since it was listed; rdreq.done is what's really there
+    if(!opts.use_debugmessages && CommentStripper::isverbatim(opts, slot.input.get(), slot.rdreq.done))
+    {
+        // nothing to strip, so the input is written back as it is
+        res.ok = true;
+        slot.wrreq.data = slot.input.get();
+        slot.wrreq.size = slot.rdreq.done;
+    }
+    else
+    {
+        {
+            SpanWriter out(slot.output);
+            CommentStripper cs(opts, slot.input.get(), slot.rdreq.done);
+            cs.setDiagStream(&msgs);
+            res.ok = cs.run(out);
+        }
+        slot.wrreq.data = &slot.output[0];
+        slot.wrreq.size = slot.output.size();
+    }
+    res.messages = msgs.str();
+    // kept busy until finish() has seen the write through
+    slot.busy = true;
+    slot.writing = true;
+    if((slot.wrreq.size == 0) || !aio.submit(&slot.wrreq))
+    {
+        slot.wrreq.error = ((slot.wrreq.size == 0) ? 0 : EIO);
+        slot.wrreq.finished = true;
+    }
+    #else
+    (void)aio;
+    #endif
+}
+
+void BatchRunner::finish(AsyncIO& aio, Staged& slot)
+{
+    #if !defined(_WIN32)
+    if(!slot.writing)
+    {
+        return;
+    }
+    aio.wait(&slot.wrreq);
+    ::close(slot.outfd);
+    slot.outfd = -1;
+    slot.writing = false;
+    slot.busy = false;
+    if(slot.wrreq.error != 0)
+    {
+        Result& res = m_results[slot.job.index];
+        std::ostringstream msgs;
+        Util::sfprintf(msgs, RMCPP_FMT("ERROR: failed to write %q\n"), slot.job.outpath);
+        res.messages += msgs.str();
+        res.ok = false;
+    }
+    #else
+    (void)aio;
+    (void)slot;
+    #endif
+}
+
+size_t BatchRunner::run(std::ostream& diagfp)
+{
+    size_t i;
+    size_t failed;
+    std::vector<Job> sorted;
+    std::vector<std::thread> threads;
+    m_results.assign(m_jobs.size(), Result());
+    m_queues = std::vector<Queue>(std::min(m_nthreads, std::max(m_jobs.size(), size_t(1))));
+    // largest first. ties are broken by input order, to keep things reproducible
+    sorted = m_jobs;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Job& a, const Job& b)
+    {
+        return (a.size > b.size);
+    });
+    for(i=0; i<sorted.size(); i++)
+    {
+        m_queues[i % m_queues.size()].jobs.push_back(sorted[i]);
+    }
+    if(m_queues.size() == 1)
+    {
+        work(0);
+    }
+    else
+    {
+        for(i=0; i<m_queues.size(); i++)
+        {
+            threads.emplace_back(&BatchRunner::work, this, i);
+        }
+        for(auto& th: threads)
+        {
+            th.join();
+        }
+    }
+    failed = 0;
+    for(i=0; i<m_results.size(); i++)
+    {
+        diagfp << m_results[i].messages;
+        if(!m_results[i].ok)
+        {
+            failed++;
+        }
+    }
+    if(failed > 0)
+    {
+        Util::sfprintf(diagfp, RMCPP_FMT("%d of %d files failed:\n"), failed, m_results.size());
+        for(i=0; i<m_results.size(); i++)
+        {
+            if(!m_results[i].ok)
+            {
+                Util::sfprintf(diagfp, RMCPP_FMT("  %s\n"), m_jobs[i].inpath);
+            }
+        }
+    }
+    diagfp.flush();
+    return failed;
+}
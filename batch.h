@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "rmcpp.h"
+#include "cache.h"
+#include "aio.h"
+
+/*
+* strips many files at once, on a pool of threads.
+*
+* jobs are sorted largest-first and dealt round-robin to per-thread queues,
+* so the big files get started early; a thread that runs out of work steals
+* from the others. messages and failures are collected per file, and
+* reported in the order the files were added, regardless of which thread
+* handled which file.
+*
+* without a cache, each thread also keeps its disk busy: the next file is read
+* (and the previous one written) through AsyncIO while the current one is stripped.
+*/
+class BatchRunner
+{
+    public:
+        struct Job
+        {
+            // position in the order files were added
+            size_t index;
+            std::string inpath;
+            std::string outpath;
+            uintmax_t size;
+        };
+
+        struct Result
+        {
+            bool ok = false;
+            // warnings, debug and error messages for this file
+            std::string messages;
+        };
+
+    private:
+        struct Queue
+        {
+            std::mutex mtx;
+            std::deque<Job> jobs;
+        };
+
+        // a job on its way through read-ahead, stripping, and write-behind; see work()
+        struct Staged
+        {
+            Job job;
+            // holds a job at all
+            bool busy = false;
+            // is read and written through AsyncIO; otherwise, runjob() does everything
+            bool async = false;
+            // the write was submitted, and has to be waited for
+            bool writing = false;
+            int infd = -1;
+            int outfd = -1;
+            std::unique_ptr<char[]> input;
+            size_t capacity = 0;
+            std::string output;
+            AsyncIO::Request rdreq;
+            AsyncIO::Request wrreq;
+        };
+
+        // only files up to this size are staged; larger ones are mapped as usual
+        static constexpr uintmax_t maxstaged = (4 * 1024 * 1024);
+
+    private:
+        CommentStripper::Options m_opts;
+        size_t m_nthreads;
+        ResultCache* m_cache;
+        std::vector<Job> m_jobs;
+        std::vector<Result> m_results;
+        std::vector<Queue> m_queues;
+
+    private:
+        bool take(size_t self, Job& dest);
+        void work(size_t self);
+        void runjob(const Job& job, Result& res);
+        bool prepareout(const Job& job, std::ostream& msgs);
+        void stage(AsyncIO& aio, const Job& job, Staged& slot);
+        void process(AsyncIO& aio, Staged& slot);
+        void finish(AsyncIO& aio, Staged& slot);
+
+    public:
+        /*
+        * <nthreads> of 0 means one thread per core.
+        */
+        BatchRunner(const CommentStripper::Options& opts, size_t nthreads);
+
+        void add(const std::string& inpath, const std::string& outpath);
+
+        /*
+        * look up (and store) results in <cache>, which may be shared with other threads
+        * and processes. null (the default) disables caching.
+        */
+        void setCache(ResultCache* cache);
+
+        /*
+        * adds <inpath>, to be written below <outdir>.
+        * the input's relative path is kept, i.e., "src/foo.c" is written to
+        * "<outdir>/src/foo.c" (leading '..' and root components are dropped).
+        */
+        void addto(const std::string& inpath, const std::string& outdir);
+
+        /**
+        * adds every file listed in <listpath>, one per line.
+        * a line may name the output file explicitly, separated by a tab
+        * ("input<TAB>output"); otherwise the output goes below <outdir> (see addto()).
+        * @returns false (and complains) if the list can't be read, or if a line
+        * has no output file while <outdir> is empty.
+        */
+        bool addlist(const std::string& listpath, const std::string& outdir);
+
+        size_t count() const
+        {
+            return m_jobs.size();
+        }
+
+        /**
+        * strips all files, then writes each file's messages to <diagfp>, in the
+        * order they were added, followed by a summary if anything failed.
+        * @returns the number of files that failed.
+        */
+        size_t run(std::ostream& diagfp);
+};
@@ -0,0 +1,632 @@
+/*
+* rmcppbench - throughput of CommentStripper on synthetic input.
+*
+* Usage:
+*   $0 [--size=<mb>] [--time=<seconds>] [--filter=<substr>] [--label=<str>] [--json=<file>]
+*      [--testdir=<dir>] [--counters]
+*
+* generates a few corpora that stress different parts of the state machine, and
+* strips each of them with every option set below, from memory into memory.
+* prints a table to standard output, and, with --json, writes the results to <file>
+* (use --label to tag a run, i.e. with the commit it was built from).
+*
+* --testdir adds every file in <dir> (i.e., test/) as a corpus of its own, repeated
+* until it's as big as the others. --counters adds hardware counters per byte
+* (see perfcount.h), as counted during the fastest run.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include "rmcpp.h"
+#include "perfcount.h"
+#include "../optionparser/optionparser.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+/*
+* a tiny, fixed-seed generator, so the corpora are the same on every run,
+* and results can be compared across commits.
+*/
+class Random
+{
+    private:
+        uint64_t m_state;
+
+    public:
+        Random(uint64_t seed): m_state(seed)
+        {
+        }
+
+        uint32_t next()
+        {
+            // xorshift64*
+            m_state ^= (m_state >> 12);
+            m_state ^= (m_state << 25);
+            m_state ^= (m_state >> 27);
+            return uint32_t((m_state * 2685821657736338717ULL) >> 32);
+        }
+
+        // [0, n)
+        size_t below(size_t n)
+        {
+            return (next() % n);
+        }
+};
+
+struct Corpus
+{
+    std::string name;
+    std::string data;
+};
+
+struct OptionSet
+{
+    const char* name;
+    CommentStripper::Options opts;
+};
+
+struct BenchResult
+{
+    std::string corpus;
+    std::string options;
+    size_t bytes;
+    size_t iterations;
+    double seconds;
+    double mbps;
+    double nsperbyte;
+    // the same, with Options::use_specialized turned off
+    double genericmbps;
+    double speedup;
+    // with --counters: each counter divided by <bytes>, if it could be counted
+    bool counted[PerfCounters::PC_COUNT] = {};
+    double perbyte[PerfCounters::PC_COUNT] = {};
+};
+
+static const char* words[] = {
+    "int", "return", "value", "count", "for", "if", "while", "buffer", "size_t", "i", "j",
+    "static", "const", "char*", "ptr", "next", "data", "result", "+", "-", "=", "==", "<", "*",
+};
+
+static void putwords(std::string& dest, Random& rnd, size_t n)
+{
+    size_t i;
+    for(i=0; i<n; i++)
+    {
+        if(i > 0)
+        {
+            dest.push_back(' ');
+        }
+        dest += words[rnd.below(sizeof(words) / sizeof(words[0]))];
+    }
+}
+
+// C with a comment on almost every line: line comments, block comments, doc blocks
+static std::string gen_commentdense(size_t size)
+{
+    std::string res;
+    Random rnd(1);
+    while(res.size() < size)
+    {
+        switch(rnd.below(4))
+        {
+            case 0:
+                res += "    ";
+                putwords(res, rnd, 3 + rnd.below(6));
+                res += "; // ";
+                putwords(res, rnd, 2 + rnd.below(8));
+                res += "\n";
+                break;
+            case 1:
+                res += "/*\n* ";
+                putwords(res, rnd, 5 + rnd.below(10));
+                res += "\n* ";
+                putwords(res, rnd, 5 + rnd.below(10));
+                res += "\n*/\n";
+                break;
+            case 2:
+                res += "    ";
+                putwords(res, rnd, 2);
+                res += " /* ";
+                putwords(res, rnd, 1 + rnd.below(3));
+                res += " */ ";
+                putwords(res, rnd, 3);
+                res += ";\n";
+                break;
+            default:
+                res += "\n";
+                break;
+        }
+    }
+    return res;
+}
+
+// mostly string and character literals, with escapes, and comment markers inside of them
+static std::string gen_strings(size_t size)
+{
+    std::string res;
+    Random rnd(2);
+    while(res.size() < size)
+    {
+        res += "    puts(\"";
+        putwords(res, rnd, 2 + rnd.below(6));
+        switch(rnd.below(4))
+        {
+            case 0:
+                res += " // not a comment";
+                break;
+            case 1:
+                res += " /* nor this */";
+                break;
+            case 2:
+                res += " \\\"quoted\\\" \\\\";
+                break;
+            default:
+                break;
+        }
+        res += "\"); c = '";
+        res += ((rnd.below(2) == 0) ? "\\''" : "/'");
+        res += "; // ";
+        putwords(res, rnd, 2);
+        res += "\n";
+    }
+    return res;
+}
+
+// pascal, with (* *) and { } comments nested several levels deep, and '' strings
+static std::string gen_pascal(size_t size)
+{
+    size_t i;
+    size_t depth;
+    std::string res;
+    Random rnd(3);
+    res += "program bench;\n";
+    while(res.size() < size)
+    {
+        res += "    s: string = (* ";
+        putwords(res, rnd, 2);
+        res += " *)'it''s (* not *) a comment';\n";
+        depth = (1 + rnd.below(8));
+        for(i=0; i<depth; i++)
+        {
+            res.append(i * 4, ' ');
+            res += ((i % 2) ? "{ " : "(* ");
+            putwords(res, rnd, 2);
+            res += "\n";
+        }
+        for(i=depth; i-- > 0;)
+        {
+            res.append(i * 4, ' ');
+            res += ((i % 2) ? "}\n" : "*)\n");
+        }
+        res += "    # ";
+        putwords(res, rnd, 3);
+        res += "\n";
+    }
+    return res;
+}
+
+// the comment dense corpus again, with CRLF line endings
+static std::string gen_crlf(size_t size)
+{
+    std::string res;
+    std::string src;
+    src = gen_commentdense(size);
+    res.reserve(src.size() + (src.size() / 16));
+    for(char ch: src)
+    {
+        if(ch == '\n')
+        {
+            res.push_back('\r');
+        }
+        res.push_back(ch);
+    }
+    return res;
+}
+
+/*
+* the file at <path>, over and over, until it's at least <size> bytes.
+* @returns an empty string if it can't be read, or is empty.
+*/
+static std::string gen_repeated(const std::filesystem::path& path, size_t size)
+{
+    std::string res;
+    std::string src;
+    std::stringstream ss;
+    std::fstream fp(path, std::ios::in | std::ios::binary);
+    ss << fp.rdbuf();
+    src = ss.str();
+    if(src.empty())
+    {
+        return res;
+    }
+    res.reserve(size + src.size());
+    while(res.size() < size)
+    {
+        res += src;
+    }
+    return res;
+}
+
+// lines of several hundred kilobytes, the odd comment in between
+static std::string gen_longlines(size_t size)
+{
+    size_t linelen;
+    size_t start;
+    std::string res;
+    Random rnd(5);
+    while(res.size() < size)
+    {
+        linelen = (256 * 1024) + rnd.below(256 * 1024);
+        start = res.size();
+        while((res.size() - start) < linelen)
+        {
+            putwords(res, rnd, 16);
+            res += ((rnd.below(8) == 0) ? " /* x */ " : " ");
+        }
+        res += "// end of line\n";
+    }
+    return res;
+}
+
+static std::vector<OptionSet> makeoptionsets()
+{
+    std::vector<OptionSet> sets;
+    OptionSet os;
+    // no messages: unterminated comments and such would only add noise
+    os.opts.use_warningmessages = false;
+    os.name = "default";
+    sets.push_back(os);
+    os.name = "--strip";
+    sets.push_back(os);
+    sets.back().opts.remove_emptylines = true;
+    os.name = "--pascal";
+    sets.push_back(os);
+    sets.back().opts.remove_pascalcomments = true;
+    os.name = "--hash";
+    sets.push_back(os);
+    sets.back().opts.remove_hashcomments = true;
+    os.name = "--convert-cpp";
+    sets.push_back(os);
+    sets.back().opts.do_convertcpp = true;
+    sets.back().opts.remove_ansicomments = false;
+    sets.back().opts.remove_cppcomments = false;
+    os.name = "--minify";
+    sets.push_back(os);
+    sets.back().opts.do_minify = true;
+    return sets;
+}
+
+/*
+* strips <corpus> with <os> over and over, until at least <mintime> seconds have passed.
+* the fastest single run is reported; on a busy machine, that is the one closest to the truth.
+* if <counters> is set, every run is counted, and the counts of the fastest one are kept.
+*/
+static BenchResult runbench(const Corpus& corpus, const char* name, const CommentStripper::Options& opts, double mintime, PerfCounters* counters)
+{
+    size_t i;
+    double best;
+    double total;
+    double secs;
+    std::string output;
+    std::ostringstream diag;
+    PerfCounters::Sample sample;
+    PerfCounters::Sample bestsample;
+    BenchResult res;
+    best = -1;
+    total = 0;
+    res.iterations = 0;
+    output.reserve(corpus.data.size() + (corpus.data.size() / 8));
+    while((total < mintime) || (res.iterations < 3))
+    {
+        output.clear();
+        if(counters != nullptr)
+        {
+            counters->start();
+        }
+        auto begin = Clock::now();
+        {
+            SpanWriter out(output);
+            CommentStripper cs(opts, corpus.data.data(), corpus.data.size());
+            cs.setDiagStream(&diag);
+            cs.run(out);
+            out.flush();
+        }
+        secs = std::chrono::duration<double>(Clock::now() - begin).count();
+        if(counters != nullptr)
+        {
+            sample = counters->stop();
+        }
+        if((best < 0) || (secs < best))
+        {
+            best = secs;
+            bestsample = sample;
+        }
+        total += secs;
+        res.iterations++;
+    }
+    res.corpus = corpus.name;
+    res.options = name;
+    res.bytes = corpus.data.size();
+    res.seconds = best;
+    res.mbps = ((double(res.bytes) / (1024.0 * 1024.0)) / best);
+    res.nsperbyte = ((best * 1e9) / double(res.bytes));
+    res.genericmbps = 0;
+    res.speedup = 0;
+    for(i=0; i<PerfCounters::PC_COUNT; i++)
+    {
+        res.counted[i] = bestsample.valid[i];
+        res.perbyte[i] = (double(bestsample.values[i]) / double(res.bytes));
+    }
+    return res;
+}
+
+/*
+* prints <value> in a column of <width>, or a dash if there's nothing to print.
+*/
+static void putcolumn(std::ostream& os, bool valid, double value, int width, int precision)
+{
+    os << " " << std::setw(width);
+    if(!valid)
+    {
+        os << "-";
+        return;
+    }
+    os << std::fixed << std::setprecision(precision) << value;
+    os.unsetf(std::ios::floatfield);
+}
+
+// the JSON keys for each of PerfCounters::Counter
+static const char* counterkeys[] = {
+    "cycles_per_byte", "instructions_per_byte", "branch_misses_per_byte", "l1d_misses_per_byte",
+};
+static_assert((sizeof(counterkeys) / sizeof(counterkeys[0])) == PerfCounters::PC_COUNT, "one key per counter");
+
+// writes <str> as a JSON string, quotes included. --label and file names may contain anything
+static void putjsonstring(std::ostream& os, const std::string& str)
+{
+    char buf[8];
+    os.put('"');
+    for(unsigned char ch: str)
+    {
+        if((ch == '"') || (ch == '\\'))
+        {
+            os.put('\\');
+            os.put(ch);
+        }
+        else if(ch < 0x20)
+        {
+            std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            os.write(buf, 6);
+        }
+        else
+        {
+            os.put(ch);
+        }
+    }
+    os.put('"');
+}
+
+static bool writejson(const std::string& path, const std::string& label, size_t corpussize, const std::vector<BenchResult>& results)
+{
+    size_t i;
+    size_t c;
+    std::fstream fp(path, std::ios::out | std::ios::binary);
+    if(!fp.good())
+    {
+        return false;
+    }
+    fp << "{\n";
+    fp << "  \"label\": ";
+    putjsonstring(fp, label);
+    fp << ",\n";
+    fp << "  \"corpus_size\": " << corpussize << ",\n";
+    fp << "  \"results\": [";
+    for(i=0; i<results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        fp << ((i == 0) ? "\n" : ",\n");
+        fp << "    {\"corpus\": ";
+        putjsonstring(fp, r.corpus);
+        fp << ", \"options\": ";
+        putjsonstring(fp, r.options);
+        fp << ", ";
+        fp << "\"bytes\": " << r.bytes << ", \"iterations\": " << r.iterations << ", ";
+        fp << std::fixed << std::setprecision(3);
+        fp << "\"mb_per_s\": " << r.mbps << ", \"ns_per_byte\": " << r.nsperbyte << ", ";
+        fp << "\"generic_mb_per_s\": " << r.genericmbps << ", \"speedup\": " << r.speedup;
+        // only what could be counted; nothing at all without --counters
+        fp << std::setprecision(6);
+        for(c=0; c<PerfCounters::PC_COUNT; c++)
+        {
+            if(r.counted[c])
+            {
+                fp << ", \"" << counterkeys[c] << "\": " << r.perbyte[c];
+            }
+        }
+        fp << "}";
+        fp.unsetf(std::ios::floatfield);
+    }
+    fp << "\n  ]\n}\n";
+    return fp.good();
+}
+
+int main(int argc, char** argv)
+{
+    size_t size;
+    double mintime;
+    bool usecounters;
+    std::string filter;
+    std::string label;
+    std::string jsonfile;
+    std::string testdir;
+    std::vector<std::filesystem::path> testfiles;
+    PerfCounters* counters;
+    std::vector<Corpus> corpora;
+    std::vector<BenchResult> results;
+    std::vector<OptionSet> optsets;
+    std::ios::sync_with_stdio(false);
+    size = (8 * 1024 * 1024);
+    mintime = 0.5;
+    usecounters = false;
+    counters = nullptr;
+    OptionParser prs;
+    prs.onUnknownOption([&](const std::string& v)
+    {
+        std::cerr << "unknown option '" << v << "'!" << std::endl;
+        return false;
+    });
+    prs.on({"--size=?"}, "size of each corpus, in megabytes (default: 8)", [&](const auto& v)
+    {
+        size = (std::strtoul(v.str().c_str(), nullptr, 10) * 1024 * 1024);
+    });
+    prs.on({"--time=?"}, "minimum time spent on each benchmark, in seconds (default: 0.5)", [&](const auto& v)
+    {
+        mintime = std::strtod(v.str().c_str(), nullptr);
+    });
+    prs.on({"--filter=?"}, "only run benchmarks whose name (<corpus>/<options>) contains <val>", [&](const auto& v)
+    {
+        filter = v.str();
+    });
+    prs.on({"--label=?"}, "stored in the JSON output, to tell runs apart (i.e., a commit hash)", [&](const auto& v)
+    {
+        label = v.str();
+    });
+    prs.on({"--json=?"}, "write results to file <val>, as JSON", [&](const auto& v)
+    {
+        jsonfile = v.str();
+    });
+    prs.on({"--testdir=?"}, "also use every file in directory <val> (i.e., test) as a corpus, repeated up to --size", [&](const auto& v)
+    {
+        testdir = v.str();
+    });
+    prs.on({"--counters"}, "count cycles, instructions, branch misses and L1D misses per byte (Linux only)", [&]
+    {
+        usecounters = true;
+    });
+    try
+    {
+        prs.parse(argc, argv);
+    }
+    catch(std::runtime_error& ex)
+    {
+        std::cerr << "error: " << ex.what() << std::endl;
+        return 1;
+    }
+    if(size == 0)
+    {
+        size = 1024;
+    }
+    corpora.push_back({"commentdense", gen_commentdense(size)});
+    corpora.push_back({"strings", gen_strings(size)});
+    corpora.push_back({"pascal", gen_pascal(size)});
+    corpora.push_back({"crlf", gen_crlf(size)});
+    corpora.push_back({"longlines", gen_longlines(size)});
+    if(!testdir.empty())
+    {
+        std::error_code ec;
+        for(const auto& ent: std::filesystem::directory_iterator(testdir, ec))
+        {
+            if(ent.is_regular_file(ec))
+            {
+                testfiles.push_back(ent.path());
+            }
+        }
+        if(ec)
+        {
+            Util::error(RMCPP_FMT("cannot read directory %q: %s"), testdir, ec.message());
+            return 1;
+        }
+        // directory order is whatever the filesystem likes
+        std::sort(testfiles.begin(), testfiles.end());
+        for(const auto& path: testfiles)
+        {
+            Corpus corpus;
+            corpus.name = ("test/" + path.filename().string());
+            corpus.data = gen_repeated(path, size);
+            if(!corpus.data.empty())
+            {
+                corpora.push_back(corpus);
+            }
+        }
+    }
+    if(usecounters)
+    {
+        counters = new PerfCounters;
+        // timing alone still works, so that's not a reason to give up
+        if(!counters->available())
+        {
+            Util::sfprintf(std::cerr, RMCPP_FMT("note: hardware counters are not available (%s); timing only\n"), counters->error());
+            delete counters;
+            counters = nullptr;
+        }
+        else if(!counters->error().empty())
+        {
+            Util::sfprintf(std::cerr, RMCPP_FMT("note: not every hardware counter is available (%s)\n"), counters->error());
+        }
+    }
+    optsets = makeoptionsets();
+    std::cout
+        << std::left << std::setw(16) << "corpus" << " " << std::setw(14) << "options" << " "
+        << std::right << std::setw(12) << "bytes" << " " << std::setw(10) << "MB/s" << " " << std::setw(10) << "ns/byte" << " "
+        << std::setw(10) << "generic" << " " << std::setw(8) << "speedup";
+    if(counters != nullptr)
+    {
+        std::cout
+            << " " << std::setw(8) << "cyc/B" << " " << std::setw(8) << "ins/B" << " " << std::setw(6) << "IPC"
+            << " " << std::setw(10) << "brmiss/B" << " " << std::setw(10) << "L1Dmiss/B";
+    }
+    std::cout << std::endl;
+    for(const auto& corpus: corpora)
+    {
+        for(const auto& os: optsets)
+        {
+            if(!filter.empty() && ((std::string(corpus.name) + "/" + os.name).find(filter) == std::string::npos))
+            {
+                continue;
+            }
+            /*
+            * every option set is run twice: once as usual, with the parser compiled
+            * for exactly these options, and once checking them at runtime.
+            */
+            CommentStripper::Options generic;
+            generic = os.opts;
+            generic.use_specialized = false;
+            results.push_back(runbench(corpus, os.name, os.opts, mintime, counters));
+            BenchResult& r = results.back();
+            r.genericmbps = runbench(corpus, os.name, generic, mintime, nullptr).mbps;
+            r.speedup = (r.mbps / r.genericmbps);
+            std::cout
+                << std::left << std::setw(16) << r.corpus << " " << std::setw(14) << r.options << " "
+                << std::right << std::setw(12) << r.bytes << " "
+                << std::fixed << std::setprecision(1) << std::setw(10) << r.mbps << " "
+                << std::setprecision(3) << std::setw(10) << r.nsperbyte << " "
+                << std::setprecision(1) << std::setw(10) << r.genericmbps << " "
+                << std::setprecision(2) << std::setw(7) << r.speedup << "x";
+            std::cout.unsetf(std::ios::floatfield);
+            if(counters != nullptr)
+            {
+                putcolumn(std::cout, r.counted[PerfCounters::PC_CYCLES], r.perbyte[PerfCounters::PC_CYCLES], 8, 3);
+                putcolumn(std::cout, r.counted[PerfCounters::PC_INSTRUCTIONS], r.perbyte[PerfCounters::PC_INSTRUCTIONS], 8, 3);
+                putcolumn(std::cout,
+                    (r.counted[PerfCounters::PC_CYCLES] && r.counted[PerfCounters::PC_INSTRUCTIONS] && (r.perbyte[PerfCounters::PC_CYCLES] > 0)),
+                    (r.perbyte[PerfCounters::PC_INSTRUCTIONS] / r.perbyte[PerfCounters::PC_CYCLES]), 6, 2
+                );
+                putcolumn(std::cout, r.counted[PerfCounters::PC_BRANCHMISSES], r.perbyte[PerfCounters::PC_BRANCHMISSES], 10, 5);
+                putcolumn(std::cout, r.counted[PerfCounters::PC_L1DMISSES], r.perbyte[PerfCounters::PC_L1DMISSES], 10, 5);
+            }
+            std::cout << std::endl;
+        }
+    }
+    delete counters;
+    if(!jsonfile.empty() && !writejson(jsonfile, label, size, results))
+    {
+        Util::error(RMCPP_FMT("cannot write results to %q"), jsonfile);
+        return 1;
+    }
+    return 0;
+}
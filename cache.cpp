@@ -0,0 +1,405 @@
+/*
+* ResultCache - see cache.h
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <unordered_map>
+#include <sys/stat.h>
+#if defined(_WIN32)
+    #include <io.h>
+    #include <fcntl.h>
+    #include <process.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#include "cache.h"
+
+namespace fs = std::filesystem;
+
+/*
+* XXH64, by Yann Collet (https://github.com/Cyan4973/xxHash, BSD licensed).
+* fast, and good enough to key a cache; the input size is part of the key as well.
+*/
+static constexpr uint64_t xxprime1 = 11400714785074694791ULL;
+static constexpr uint64_t xxprime2 = 14029467366897019727ULL;
+static constexpr uint64_t xxprime3 = 1609587929392839161ULL;
+static constexpr uint64_t xxprime4 = 9650029242287828579ULL;
+static constexpr uint64_t xxprime5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t v, int n)
+{
+    return ((v << n) | (v >> (64 - n)));
+}
+
+// assembled byte by byte, so it's the same on any host; compilers turn this into a single load
+static inline uint64_t readle64(const unsigned char* p)
+{
+    return (
+        (uint64_t(p[0]) << 0) | (uint64_t(p[1]) << 8) | (uint64_t(p[2]) << 16) | (uint64_t(p[3]) << 24) |
+        (uint64_t(p[4]) << 32) | (uint64_t(p[5]) << 40) | (uint64_t(p[6]) << 48) | (uint64_t(p[7]) << 56)
+    );
+}
+
+static inline uint64_t readle32(const unsigned char* p)
+{
+    return ((uint64_t(p[0]) << 0) | (uint64_t(p[1]) << 8) | (uint64_t(p[2]) << 16) | (uint64_t(p[3]) << 24));
+}
+
+static inline uint64_t xxround(uint64_t acc, uint64_t input)
+{
+    acc += (input * xxprime2);
+    acc = rotl64(acc, 31);
+    return (acc * xxprime1);
+}
+
+static inline uint64_t xxmerge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxround(0, val);
+    return ((acc * xxprime1) + xxprime4);
+}
+
+uint64_t ResultCache::hash(const char* data, size_t size, uint64_t seed)
+{
+    uint64_t h;
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+    uint64_t v4;
+    const unsigned char* p;
+    const unsigned char* end;
+    p = (const unsigned char*)data;
+    end = (p + size);
+    if(size >= 32)
+    {
+        v1 = (seed + xxprime1 + xxprime2);
+        v2 = (seed + xxprime2);
+        v3 = seed;
+        v4 = (seed - xxprime1);
+        while((end - p) >= 32)
+        {
+            v1 = xxround(v1, readle64(p + 0));
+            v2 = xxround(v2, readle64(p + 8));
+            v3 = xxround(v3, readle64(p + 16));
+            v4 = xxround(v4, readle64(p + 24));
+            p += 32;
+        }
+        h = (rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18));
+        h = xxmerge(h, v1);
+        h = xxmerge(h, v2);
+        h = xxmerge(h, v3);
+        h = xxmerge(h, v4);
+    }
+    else
+    {
+        h = (seed + xxprime5);
+    }
+    h += uint64_t(size);
+    while((end - p) >= 8)
+    {
+        h ^= xxround(0, readle64(p));
+        h = ((rotl64(h, 27) * xxprime1) + xxprime4);
+        p += 8;
+    }
+    if((end - p) >= 4)
+    {
+        h ^= (readle32(p) * xxprime1);
+        h = ((rotl64(h, 23) * xxprime2) + xxprime3);
+        p += 4;
+    }
+    while(p < end)
+    {
+        h ^= (uint64_t(*p) * xxprime5);
+        h = (rotl64(h, 11) * xxprime1);
+        p++;
+    }
+    h ^= (h >> 33);
+    h *= xxprime2;
+    h ^= (h >> 29);
+    h *= xxprime3;
+    h ^= (h >> 32);
+    return h;
+}
+
+ResultCache::ResultCache(const std::string& dir, uint64_t maxsize):
+    m_dir(dir), m_maxsize(maxsize), m_cursize(-1), m_unscanned(0), m_rng(std::random_device()()),
+    m_hits(0), m_misses(0), m_stores(0), m_evictions(0)
+{
+}
+
+std::string ResultCache::makekey(const CommentStripper::Options& opts, const char* data, size_t size)
+{
+    char buf[64];
+    std::string optstr;
+    optstr = opts.serialize();
+    std::snprintf(buf, sizeof(buf), "%016llx%016llx-%llx",
+        (unsigned long long)hash(data, size, 0),
+        (unsigned long long)hash(optstr.data(), optstr.size(), 0),
+        (unsigned long long)size
+    );
+    return buf;
+}
+
+std::string ResultCache::entrypath(const std::string& key, const char* ext) const
+{
+    return (fs::path(m_dir) / key.substr(0, 2) / (key + ext)).string();
+}
+
+bool ResultCache::writefile(const std::string& path, const std::string& data)
+{
+    bool ok;
+    std::error_code ec;
+    std::string tmppath;
+    static std::atomic<unsigned long> counter(0);
+    /*
+    * written under a name no other process or thread will use, then renamed into
+    * place. rename() is atomic, so anyone looking up <path> either sees the whole
+    * file, or none at all.
+    */
+    #if defined(_WIN32)
+    tmppath = (path + ".tmp." + std::to_string(_getpid()) + "." + std::to_string(counter++));
+    #else
+    tmppath = (path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++));
+    #endif
+    {
+        SpanWriter out;
+        if(!out.open(tmppath))
+        {
+            return false;
+        }
+        out.span(data.data(), data.size());
+        ok = out.flush();
+    }
+    if(ok)
+    {
+        fs::rename(tmppath, path, ec);
+        ok = !ec;
+    }
+    if(!ok)
+    {
+        fs::remove(tmppath, ec);
+    }
+    return ok;
+}
+
+ResultCache::FetchResult ResultCache::fetch(const std::string& key, SpanWriter& out, std::ostream* commentfp)
+{
+    int fd;
+    bool hit;
+    FetchResult res;
+    std::error_code ec;
+    std::string outpath;
+    #if defined(_WIN32)
+    struct _stat64 st;
+    #else
+    struct stat st;
+    #endif
+    outpath = entrypath(key, ".out");
+    #if defined(_WIN32)
+    fd = _open(outpath.c_str(), _O_RDONLY | _O_BINARY);
+    #else
+    fd = ::open(outpath.c_str(), O_RDONLY);
+    #endif
+    if(fd == -1)
+    {
+        m_misses++;
+        return FR_MISS;
+    }
+    // the size of what was actually opened - the entry might be replaced in the meantime
+    #if defined(_WIN32)
+    hit = (_fstat64(fd, &st) == 0);
+    #else
+    hit = (fstat(fd, &st) == 0);
+    #endif
+    if(hit && (commentfp != nullptr))
+    {
+        MappedFile comm;
+        hit = comm.open(entrypath(key, ".comm"));
+        if(hit)
+        {
+            commentfp->write(comm.data(), comm.size());
+        }
+    }
+    res = FR_MISS;
+    if(hit)
+    {
+        // mark it as recently used. whether that works or not doesn't matter much
+        fs::last_write_time(outpath, fs::file_time_type::clock::now(), ec);
+        res = FR_FAILED;
+        if(out.copyfrom(fd, st.st_size))
+        {
+            res = FR_HIT;
+            m_hits++;
+        }
+    }
+    else
+    {
+        m_misses++;
+    }
+    #if defined(_WIN32)
+    _close(fd);
+    #else
+    ::close(fd);
+    #endif
+    return res;
+}
+
+void ResultCache::store(const std::string& key, const std::string& output, const std::string* comments)
+{
+    uint64_t added;
+    std::error_code ec;
+    std::string outpath;
+    outpath = entrypath(key, ".out");
+    fs::create_directories(fs::path(outpath).parent_path(), ec);
+    added = output.size();
+    // the comments go first: once the .out file exists, the entry is complete
+    if(comments != nullptr)
+    {
+        if(!writefile(entrypath(key, ".comm"), *comments))
+        {
+            return;
+        }
+        added += comments->size();
+    }
+    if(!writefile(outpath, output))
+    {
+        return;
+    }
+    m_stores++;
+    evict(added);
+}
+
+/*
+* deletes the least recently used entries, if the cache has grown beyond its limit.
+* <added> is how much the store that got here added.
+*/
+void ResultCache::evict(uint64_t added)
+{
+    /*
+    * an entry: its .out and .comm file, which go together. a hit only bumps the .out
+    * file, so deleting them one by one would lose the comments of entries in use.
+    */
+    struct Item
+    {
+        // the path of either, without the extension
+        fs::path stem;
+        uint64_t size;
+        // of the newer one
+        fs::file_time_type mtime;
+        bool hasout;
+    };
+    int64_t total;
+    int64_t lowmark;
+    uint64_t size;
+    std::error_code ec;
+    fs::path path;
+    fs::file_time_type mtime;
+    std::vector<Item> items;
+    std::unordered_map<std::string, size_t> byname;
+    uint64_t sample;
+    std::lock_guard<std::mutex> lock(m_evictmtx);
+    if(m_maxsize == 0)
+    {
+        return;
+    }
+    if(m_cursize >= 0)
+    {
+        m_cursize += added;
+        if(uint64_t(m_cursize) <= m_maxsize)
+        {
+            return;
+        }
+    }
+    else
+    {
+        /*
+        * the size isn't known yet, and finding out means walking the whole directory -
+        * too much for every process that only stores one entry (say, one compile in a
+        * big build). so a store only scans with a chance of its size in a tenth of the
+        * limit: however many processes share the cache, it's scanned about once for
+        * every tenth of the limit stored, which is also about how far it can overshoot.
+        */
+        m_unscanned += added;
+        sample = std::max<uint64_t>(m_maxsize / 10, 1);
+        if((m_unscanned < sample) && (std::uniform_int_distribution<uint64_t>(0, sample - 1)(m_rng) >= added))
+        {
+            return;
+        }
+    }
+    total = 0;
+    for(auto it=fs::recursive_directory_iterator(m_dir, ec); !ec && (it != fs::recursive_directory_iterator()); it.increment(ec))
+    {
+        if(!it->is_regular_file(ec))
+        {
+            continue;
+        }
+        path = it->path();
+        size = it->file_size(ec);
+        mtime = it->last_write_time(ec);
+        if(ec)
+        {
+            // someone else deleted it in the meantime
+            ec.clear();
+            continue;
+        }
+        // leftovers of a crashed process. anything younger may still be being written
+        if(path.string().find(".tmp.") != std::string::npos)
+        {
+            if((fs::file_time_type::clock::now() - mtime) > std::chrono::hours(1))
+            {
+                fs::remove(path, ec);
+                ec.clear();
+            }
+            continue;
+        }
+        total += size;
+        auto found = byname.emplace(fs::path(path).replace_extension().string(), items.size());
+        if(found.second)
+        {
+            items.push_back({fs::path(path).replace_extension(), 0, mtime, false});
+        }
+        Item& item = items[found.first->second];
+        item.size += size;
+        item.mtime = std::max(item.mtime, mtime);
+        item.hasout = (item.hasout || (path.extension() == ".out"));
+    }
+    if(uint64_t(total) > m_maxsize)
+    {
+        /*
+        * least recently used first. this goes a bit below the limit, so that the
+        * next few stores don't immediately trigger another scan.
+        */
+        lowmark = int64_t(m_maxsize - (m_maxsize / 10));
+        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b)
+        {
+            return (a.mtime < b.mtime);
+        });
+        for(const auto& item: items)
+        {
+            if(total <= lowmark)
+            {
+                break;
+            }
+            // the .out file first, so that nobody finds an entry without its comments.
+            // if another process got there first, that's fine too
+            if(fs::remove(fs::path(item.stem).replace_extension(".out"), ec) && item.hasout)
+            {
+                m_evictions++;
+            }
+            ec.clear();
+            fs::remove(fs::path(item.stem).replace_extension(".comm"), ec);
+            ec.clear();
+            total -= item.size;
+        }
+    }
+    m_cursize = total;
+}
+
+void ResultCache::report(std::ostream& fp) const
+{
+    Util::sfprintf(fp, RMCPP_FMT("cache: %d hits, %d misses, %d stored, %d evicted\n"),
+        size_t(m_hits), size_t(m_misses), size_t(m_stores), size_t(m_evictions));
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include "rmcpp.h"
+
+/*
+* a persistent, content-addressed cache of stripped output.
+*
+* entries are keyed by a hash of the input bytes, its size, and the options it was
+* stripped with (see CommentStripper::Options::serialize()), and stored as plain
+* files below the cache directory:
+*
+*   <dir>/<first two hex digits of the key>/<key>.out   - the stripped output
+*   <dir>/<first two hex digits of the key>/<key>.comm  - removed comments, if they were asked for
+*
+* several processes can share one cache directory: entries are written to a temporary
+* file first, and then renamed into place, so readers never see partial entries.
+* a hit bumps the modification time of its .out file; when the cache grows beyond its size
+* limit (roughly - nobody keeps an exact total; see evict()), the least recently used
+* entries are deleted, .out and .comm together.
+*/
+class ResultCache
+{
+    public:
+        // default size limit
+        static constexpr uint64_t defaultmaxsize = (uint64_t(256) * 1024 * 1024);
+
+        // what fetch() found
+        enum FetchResult
+        {
+            FR_MISS,
+            FR_HIT,
+            // there was an entry, but copying it out failed - part of it may have been written already
+            FR_FAILED,
+        };
+
+    private:
+        std::string m_dir;
+        uint64_t m_maxsize;
+
+        /*
+        * what this process thinks the cache size is, once it has scanned the directory
+        * (in evict()). -1 until then; since scanning a big cache isn't cheap, a process
+        * only does that for a random sample of its stores (see evict()), or once
+        * m_unscanned gets large.
+        */
+        int64_t m_cursize;
+        // bytes stored by this process while m_cursize is still -1
+        uint64_t m_unscanned;
+        std::minstd_rand m_rng;
+        std::mutex m_evictmtx;
+
+        std::atomic<size_t> m_hits;
+        std::atomic<size_t> m_misses;
+        std::atomic<size_t> m_stores;
+        std::atomic<size_t> m_evictions;
+
+    private:
+        std::string entrypath(const std::string& key, const char* ext) const;
+        bool writefile(const std::string& path, const std::string& data);
+        void evict(uint64_t added);
+
+    public:
+        /*
+        * <maxsize> is in bytes; 0 means no limit.
+        */
+        ResultCache(const std::string& dir, uint64_t maxsize);
+
+        /**
+        * @returns a 64 bit hash of [data, data+size) (XXH64).
+        */
+        static uint64_t hash(const char* data, size_t size, uint64_t seed);
+
+        /**
+        * @returns the key for <size> bytes of input at <data>, stripped with <opts>.
+        */
+        static std::string makekey(const CommentStripper::Options& opts, const char* data, size_t size);
+
+        /**
+        * if there is an entry for <key>, writes its output to <out>, and its comments
+        * to <commentfp> (if not null).
+        * @returns FR_MISS if there is none, including if comments were asked for, but not stored.
+        * FR_FAILED is a write error rather than a miss: stripping again would only add to
+        * whatever made it to <out>.
+        */
+        FetchResult fetch(const std::string& key, SpanWriter& out, std::ostream* commentfp);
+
+        /*
+        * stores <output> (and <comments>, if not null) as the entry for <key>.
+        * failures are silently ignored; it's just a cache.
+        */
+        void store(const std::string& key, const std::string& output, const std::string* comments);
+
+        // writes the hit/miss counters to <fp>
+        void report(std::ostream& fp) const;
+};
@@ -0,0 +1,263 @@
+/*
+* the C interface - see capi.h
+*/
+
+// exports the functions from a DLL, on Windows
+#define RMCPP_BUILDING_LIB
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include "capi.h"
+#include "snippet.h"
+
+struct rmcpp_stripper
+{
+    SnippetStripper snippets;
+    std::ostringstream diag;
+    std::string output;
+    std::string messages;
+    rmcpp_comment_fn commentfn;
+    void* userdata;
+
+    rmcpp_stripper(const CommentStripper::Options& opts): snippets(opts), commentfn(nullptr), userdata(nullptr)
+    {
+        snippets.stripper().setDiagStream(&diag);
+    }
+};
+
+/*
+* true if <opts> (as passed in) is big enough to hold <field>.
+* callers built against an older capi.h pass a smaller struct; whatever isn't in it keeps its default.
+*/
+#define RMCPP_HASFIELD(opts, field) \
+    ((opts)->size >= (offsetof(rmcpp_options, field) + sizeof((opts)->field)))
+
+/*
+* @returns false if <copts> isn't usable at all.
+*/
+static bool makeoptions(const rmcpp_options* copts, CommentStripper::Options& opts)
+{
+    if((copts == nullptr) || !RMCPP_HASFIELD(copts, warnings))
+    {
+        return false;
+    }
+    opts.use_warningmessages = (copts->warnings != 0);
+    if(RMCPP_HASFIELD(copts, strip_empty_lines))
+    {
+        opts.remove_emptylines = (copts->strip_empty_lines != 0);
+    }
+    if(RMCPP_HASFIELD(copts, keep_ansi))
+    {
+        opts.remove_ansicomments = (copts->keep_ansi == 0);
+    }
+    if(RMCPP_HASFIELD(copts, keep_cpp))
+    {
+        opts.remove_cppcomments = (copts->keep_cpp == 0);
+    }
+    if(RMCPP_HASFIELD(copts, pascal))
+    {
+        opts.remove_pascalcomments = (copts->pascal != 0);
+    }
+    if(RMCPP_HASFIELD(copts, hash))
+    {
+        opts.remove_hashcomments = (copts->hash != 0);
+    }
+    // same as --convert-cpp: does not remove anything
+    if(RMCPP_HASFIELD(copts, convert_cpp) && (copts->convert_cpp != 0))
+    {
+        opts.do_convertcpp = true;
+        opts.remove_ansicomments = false;
+        opts.remove_cppcomments = false;
+        opts.remove_hashcomments = false;
+        opts.remove_pascalcomments = false;
+    }
+    if(RMCPP_HASFIELD(copts, minify))
+    {
+        opts.do_minify = (copts->minify != 0);
+    }
+    if(RMCPP_HASFIELD(copts, minify_indent) && (copts->minify_indent != 0))
+    {
+        opts.do_minify = true;
+        opts.minify_dropindent = true;
+    }
+    if(RMCPP_HASFIELD(copts, filename) && (copts->filename != nullptr))
+    {
+        opts.infilename = copts->filename;
+    }
+    return true;
+}
+
+static int commentkind(CommentStripper::State st)
+{
+    switch(st)
+    {
+        case CommentStripper::CT_CPPCOMM:
+            return RMCPP_COMMENT_CPP;
+        case CommentStripper::CT_PASCALCOMM:
+            return RMCPP_COMMENT_PASCAL;
+        case CommentStripper::CT_HASHCOMM:
+            return RMCPP_COMMENT_HASH;
+        default:
+            break;
+    }
+    return RMCPP_COMMENT_ANSI;
+}
+
+int rmcpp_abi_version(void)
+{
+    return RMCPP_ABI_VERSION;
+}
+
+void rmcpp_options_init(rmcpp_options* opts)
+{
+    CommentStripper::Options defaults;
+    if(opts == nullptr)
+    {
+        return;
+    }
+    opts->size = sizeof(rmcpp_options);
+    opts->warnings = defaults.use_warningmessages;
+    opts->strip_empty_lines = defaults.remove_emptylines;
+    opts->keep_ansi = !defaults.remove_ansicomments;
+    opts->keep_cpp = !defaults.remove_cppcomments;
+    opts->pascal = defaults.remove_pascalcomments;
+    opts->hash = defaults.remove_hashcomments;
+    opts->convert_cpp = defaults.do_convertcpp;
+    opts->minify = defaults.do_minify;
+    opts->minify_indent = defaults.minify_dropindent;
+    opts->filename = nullptr;
+}
+
+rmcpp_stripper* rmcpp_new(const rmcpp_options* copts)
+{
+    CommentStripper::Options opts;
+    if(!makeoptions(copts, opts))
+    {
+        return nullptr;
+    }
+    try
+    {
+        return new rmcpp_stripper(opts);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void rmcpp_free(rmcpp_stripper* st)
+{
+    delete st;
+}
+
+void rmcpp_set_comment_callback(rmcpp_stripper* st, rmcpp_comment_fn fn, void* userdata)
+{
+    if(st == nullptr)
+    {
+        return;
+    }
+    st->commentfn = fn;
+    st->userdata = userdata;
+    if(fn == nullptr)
+    {
+        st->snippets.stripper().onCommentRange(nullptr);
+        return;
+    }
+    st->snippets.stripper().onCommentRange([st](const CommentStripper::CommentInfo& ci)
+    {
+        rmcpp_comment cm;
+        cm.kind = commentkind(ci.kind);
+        cm.offset = ci.offset;
+        cm.length = ci.length;
+        cm.text = ci.text.data();
+        cm.startline = ci.startline;
+        cm.startcol = ci.startcol;
+        cm.endline = ci.endline;
+        cm.endcol = ci.endcol;
+        return (st->commentfn(&cm, st->userdata) != 0);
+    });
+}
+
+int rmcpp_strip(rmcpp_stripper* st, const char* in, size_t inlen, const char** out, size_t* outlen)
+{
+    bool ok;
+    if((st == nullptr) || ((in == nullptr) && (inlen > 0)) || (out == nullptr) || (outlen == nullptr))
+    {
+        return RMCPP_EINVAL;
+    }
+    try
+    {
+        st->diag.str(std::string());
+        st->diag.clear();
+        ok = st->snippets.strip(std::string_view(((in == nullptr) ? "" : in), inlen), st->output);
+        st->messages = st->diag.str();
+    }
+    catch(const std::bad_alloc&)
+    {
+        return RMCPP_ENOMEM;
+    }
+    *out = st->output.data();
+    *outlen = st->output.size();
+    return (ok ? RMCPP_OK : RMCPP_FAILED);
+}
+
+const char* rmcpp_messages(const rmcpp_stripper* st, size_t* len)
+{
+    if(st == nullptr)
+    {
+        return nullptr;
+    }
+    if(len != nullptr)
+    {
+        *len = st->messages.size();
+    }
+    return st->messages.c_str();
+}
+
+int rmcpp_strip_buffer(const rmcpp_options* opts, const char* in, size_t inlen, char** out, size_t* outlen,
+    rmcpp_comment_fn fn, void* userdata)
+{
+    int rc;
+    size_t len;
+    const char* data;
+    rmcpp_stripper* st;
+    CommentStripper::Options checked;
+    if((out == nullptr) || (outlen == nullptr) || !makeoptions(opts, checked))
+    {
+        return RMCPP_EINVAL;
+    }
+    *out = nullptr;
+    *outlen = 0;
+    st = rmcpp_new(opts);
+    if(st == nullptr)
+    {
+        return RMCPP_ENOMEM;
+    }
+    rmcpp_set_comment_callback(st, fn, userdata);
+    rc = rmcpp_strip(st, in, inlen, &data, &len);
+    if(rc >= 0)
+    {
+        // never malloc(0), which may well return null
+        *out = (char*)std::malloc(len + 1);
+        if(*out == nullptr)
+        {
+            rc = RMCPP_ENOMEM;
+        }
+        else
+        {
+            std::memcpy(*out, data, len);
+            (*out)[len] = 0;
+            *outlen = len;
+        }
+    }
+    rmcpp_free(st);
+    return rc;
+}
+
+void rmcpp_free_buffer(char* buf)
+{
+    std::free(buf);
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <stddef.h>
+
+/*
+* the C interface to rmcpp, as exported by librmcpp.a and librmcpp.so (make buildlib).
+*
+* plain C, so that it can be used from C and anything with a C FFI, and stable: the
+* shared library exports nothing else, and neither the functions nor the layout of
+* the structs below change in incompatible ways. new options are only ever appended
+* to rmcpp_options, which is why it carries its own size.
+*
+* no C++ exceptions ever leave these functions; running out of memory is RMCPP_ENOMEM.
+* a stripper may be used by one thread at a time; use one per thread.
+*
+* linking the static library also takes the C++ runtime, i.e., -lstdc++ -pthread.
+*/
+
+#if defined(_WIN32)
+    #if defined(RMCPP_BUILDING_LIB)
+        #define RMCPP_API __declspec(dllexport)
+    #else
+        #define RMCPP_API
+    #endif
+#else
+    #define RMCPP_API __attribute__((visibility("default")))
+#endif
+
+// bumped whenever something is added; see rmcpp_abi_version()
+#define RMCPP_ABI_VERSION 1
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum
+{
+    // stripped without complaints
+    RMCPP_OK = 0,
+    // stripped, but the input had issues (such as an unterminated literal); see rmcpp_messages()
+    RMCPP_FAILED = 1,
+    // a null pointer, or options that aren't rmcpp_options
+    RMCPP_EINVAL = -1,
+    RMCPP_ENOMEM = -2,
+};
+
+// kinds of comments, as in rmcpp_comment
+enum
+{
+    RMCPP_COMMENT_CPP = 1,
+    RMCPP_COMMENT_ANSI = 2,
+    RMCPP_COMMENT_PASCAL = 3,
+    RMCPP_COMMENT_HASH = 4,
+};
+
+/*
+* the same as the command line options of the same name.
+* always set up with rmcpp_options_init() first, then change what needs changing.
+*/
+typedef struct rmcpp_options
+{
+    // sizeof(rmcpp_options), as the caller was compiled with. set by rmcpp_options_init()
+    size_t size;
+
+    // nonzero to collect warnings (see rmcpp_messages()). default: 1
+    int warnings;
+    // --strip. default: 0
+    int strip_empty_lines;
+    // --keepansi, --keepcpp. default: 0
+    int keep_ansi;
+    int keep_cpp;
+    // --pascal, --hash. default: 0
+    int pascal;
+    int hash;
+    // --convert-cpp; implies keeping every comment. default: 0
+    int convert_cpp;
+    // --minify and --minify-indent. default: 0
+    int minify;
+    int minify_indent;
+
+    // the name used in warnings; may be null. copied by rmcpp_new()
+    const char* filename;
+} rmcpp_options;
+
+/*
+* a removed comment, exactly as it appears in the input: delimiters included, but not
+* the newline that ends a line comment. <text> points into the input.
+*/
+typedef struct rmcpp_comment
+{
+    // one of RMCPP_COMMENT_*
+    int kind;
+    size_t offset;
+    size_t length;
+    const char* text;
+    // line and column of the first and the last character, counting from 1
+    long startline;
+    long startcol;
+    long endline;
+    long endcol;
+} rmcpp_comment;
+
+/*
+* called for every removed comment, in order. <comment> is only valid during the call.
+* return 0 to stop receiving comments until the next strip.
+*/
+typedef int (*rmcpp_comment_fn)(const rmcpp_comment* comment, void* userdata);
+
+typedef struct rmcpp_stripper rmcpp_stripper;
+
+// @returns RMCPP_ABI_VERSION, as the library was built with
+RMCPP_API int rmcpp_abi_version(void);
+
+// fills in <opts> with the defaults (the same as rmcpp's), and sets its size
+RMCPP_API void rmcpp_options_init(rmcpp_options* opts);
+
+/**
+* sets up a stripper for any number of inputs, all stripped with <opts>.
+* reusing one is much cheaper than rmcpp_strip_buffer() for every input.
+* @returns null if <opts> is invalid, or memory ran out.
+*/
+RMCPP_API rmcpp_stripper* rmcpp_new(const rmcpp_options* opts);
+
+RMCPP_API void rmcpp_free(rmcpp_stripper* st);
+
+/*
+* <fn> is called with <userdata> for every comment from then on. null to stop.
+* comments are only looked for while a callback is set.
+*/
+RMCPP_API void rmcpp_set_comment_callback(rmcpp_stripper* st, rmcpp_comment_fn fn, void* userdata);
+
+/**
+* strips [in, in+inlen). <*out> and <*outlen> are set to the output, which belongs to <st>,
+* and stays valid until the next call with <st>.
+* @returns RMCPP_OK, RMCPP_FAILED (the output is still set), or an error.
+*/
+RMCPP_API int rmcpp_strip(rmcpp_stripper* st, const char* in, size_t inlen, const char** out, size_t* outlen);
+
+/**
+* @returns the warnings of the last rmcpp_strip(), as rmcpp would have written them to
+* stderr, terminated with a zero byte. empty if there were none. valid until the next call with <st>.
+*/
+RMCPP_API const char* rmcpp_messages(const rmcpp_stripper* st, size_t* len);
+
+/**
+* strips [in, in+inlen) in one go, calling <fn> (if not null) for every comment.
+* <*out> is set to the output (plus a terminating zero byte, not counted in <*outlen>),
+* allocated with malloc(); free it with rmcpp_free_buffer().
+* @returns the same as rmcpp_strip(). <*out> is null on errors.
+*/
+RMCPP_API int rmcpp_strip_buffer(const rmcpp_options* opts, const char* in, size_t inlen, char** out, size_t* outlen,
+    rmcpp_comment_fn fn, void* userdata);
+
+RMCPP_API void rmcpp_free_buffer(char* buf);
+
+#if defined(__cplusplus)
+}
+#endif
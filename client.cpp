@@ -0,0 +1,342 @@
+/*
+* rmcppc - strips files with a running `rmcpp --serve`.
+*
+* Usage:
+*   $0 <socket> [options] [inputfile [outputfile]]
+*
+* takes the same options as rmcpp itself (-d, -w, -s, -a, -c, -p, -l, --convert-cpp, --minify,
+* --minify-indent, -o/--writecomments), and behaves the same, only without the startup cost.
+* without an input file (or with "-"), standard input is sent to the server.
+*
+* deliberately uses nothing but plain system calls: no iostreams, no option parser.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <climits>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "protocol.h"
+
+static void complain(const char* what, const char* arg)
+{
+    std::fprintf(stderr, "rmcppc: %s '%s': %s\n", what, arg, std::strerror(errno));
+}
+
+// write() to files and pipes. Protocol::writeall() only does sockets
+static bool writefd(int fd, const char* data, size_t size)
+{
+    ssize_t rc;
+    while(size > 0)
+    {
+        rc = ::write(fd, data, size);
+        if(rc == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += rc;
+        size -= rc;
+    }
+    return true;
+}
+
+// passes the next <size> bytes from the server on to <destfd> (or drops them, if <destfd> is -1)
+static bool relay(int sockfd, int destfd, uint64_t size)
+{
+    size_t want;
+    bool ok;
+    static char buf[64 * 1024];
+    ok = true;
+    while(size > 0)
+    {
+        want = ((size < sizeof(buf)) ? size_t(size) : sizeof(buf));
+        if(!Protocol::readall(sockfd, buf, want))
+        {
+            return false;
+        }
+        if((destfd != -1) && ok)
+        {
+            // keep reading even if writing fails, so the rest of the response doesn't get mixed up
+            ok = writefd(destfd, buf, want);
+        }
+        size -= want;
+    }
+    return ok;
+}
+
+static bool readstdin(std::string& dest)
+{
+    ssize_t rc;
+    char buf[64 * 1024];
+    while(true)
+    {
+        rc = ::read(0, buf, sizeof(buf));
+        if(rc == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if(rc == 0)
+        {
+            return true;
+        }
+        dest.append(buf, rc);
+    }
+}
+
+static int connectto(const char* sockpath)
+{
+    int fd;
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(std::strlen(sockpath) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    std::strcpy(addr.sun_path, sockpath);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+    {
+        return -1;
+    }
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+    int sockfd;
+    int outfd;
+    int commfd;
+    uint32_t flags;
+    uint32_t kind;
+    uint32_t status;
+    uint64_t outlen;
+    uint64_t commlen;
+    uint64_t msglen;
+    bool ok;
+    const char* arg;
+    const char* infile;
+    const char* outfile;
+    const char* commfile;
+    std::string payload;
+    std::string displayname;
+    struct stat inst;
+    struct stat outst;
+    char resolved[PATH_MAX];
+    unsigned char reqhdr[Protocol::requestheadersize];
+    unsigned char resphdr[Protocol::responseheadersize];
+    if(argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <socket> [options] [inputfile [outputfile]]\n", argv[0]);
+        return 1;
+    }
+    flags = 0;
+    infile = nullptr;
+    outfile = nullptr;
+    commfile = nullptr;
+    for(i=2; i<argc; i++)
+    {
+        arg = argv[i];
+        if((std::strcmp(arg, "-d") == 0) || (std::strcmp(arg, "--debug") == 0))
+        {
+            flags |= Protocol::RF_DEBUG;
+        }
+        else if((std::strcmp(arg, "-w") == 0) || (std::strcmp(arg, "--nowarnings") == 0))
+        {
+            flags |= Protocol::RF_NOWARNINGS;
+        }
+        else if((std::strcmp(arg, "-s") == 0) || (std::strcmp(arg, "--strip") == 0))
+        {
+            flags |= Protocol::RF_STRIP;
+        }
+        else if((std::strcmp(arg, "-a") == 0) || (std::strcmp(arg, "--keepansi") == 0))
+        {
+            flags |= Protocol::RF_KEEPANSI;
+        }
+        else if((std::strcmp(arg, "-c") == 0) || (std::strcmp(arg, "--keepcpp") == 0))
+        {
+            flags |= Protocol::RF_KEEPCPP;
+        }
+        else if((std::strcmp(arg, "-p") == 0) || (std::strcmp(arg, "--pascal") == 0))
+        {
+            flags |= Protocol::RF_PASCAL;
+        }
+        else if((std::strcmp(arg, "-l") == 0) || (std::strcmp(arg, "--hash") == 0))
+        {
+            flags |= Protocol::RF_HASH;
+        }
+        else if(std::strcmp(arg, "--convert-cpp") == 0)
+        {
+            flags |= Protocol::RF_CONVERTCPP;
+        }
+        else if(std::strcmp(arg, "--minify") == 0)
+        {
+            flags |= Protocol::RF_MINIFY;
+        }
+        else if(std::strcmp(arg, "--minify-indent") == 0)
+        {
+            flags |= Protocol::RF_MINIFYINDENT;
+        }
+        else if((std::strncmp(arg, "-o", 2) == 0) && (arg[2] != 0))
+        {
+            commfile = (arg + 2);
+        }
+        else if(std::strncmp(arg, "--writecomments=", 16) == 0)
+        {
+            commfile = (arg + 16);
+        }
+        else if((arg[0] == '-') && (arg[1] != 0))
+        {
+            std::fprintf(stderr, "rmcppc: unknown option '%s'!\n", arg);
+            return 1;
+        }
+        else if(infile == nullptr)
+        {
+            infile = arg;
+        }
+        else if(outfile == nullptr)
+        {
+            outfile = arg;
+        }
+        else
+        {
+            std::fprintf(stderr, "rmcppc: too many arguments\n");
+            return 1;
+        }
+    }
+    /*
+    * named files are read by the server itself, so their path has to make sense
+    * from where the server runs. messages still name them as they were typed here,
+    * just like rmcpp does. standard input is sent along with the request.
+    */
+    if((infile == nullptr) || (std::strcmp(infile, "-") == 0))
+    {
+        kind = Protocol::RK_INLINE;
+        if(!readstdin(payload))
+        {
+            complain("cannot read", "<stdin>");
+            return 1;
+        }
+        if(payload.size() > Protocol::maxinline)
+        {
+            std::fprintf(stderr, "rmcppc: standard input is too large for the server; use rmcpp instead\n");
+            return 1;
+        }
+    }
+    else
+    {
+        kind = Protocol::RK_PATH;
+        if(realpath(infile, resolved) == nullptr)
+        {
+            std::fprintf(stderr, "ERROR: cannot open \"%s\" for reading\n", infile);
+            return 1;
+        }
+        payload = resolved;
+        displayname = infile;
+        if(displayname.size() > Protocol::maxpath)
+        {
+            displayname = payload;
+        }
+    }
+    if(commfile != nullptr)
+    {
+        flags |= Protocol::RF_COMMENTS;
+    }
+    outfd = 1;
+    commfd = -1;
+    if(outfile != nullptr)
+    {
+        /* same as rmcpp: ensure we do not accidently clobber the input file! */
+        if((kind == Protocol::RK_PATH) && (::stat(outfile, &outst) == 0) && (::stat(infile, &inst) == 0))
+        {
+            if((inst.st_dev == outst.st_dev) && (inst.st_ino == outst.st_ino))
+            {
+                std::fprintf(stderr, "ERROR: outputfile \"%s\" is also inputfile!\n", outfile);
+                return 1;
+            }
+        }
+    }
+    sockfd = connectto(argv[1]);
+    if(sockfd == -1)
+    {
+        complain("cannot connect to", argv[1]);
+        return 1;
+    }
+    Protocol::putle(reqhdr, Protocol::requestmagic, 4);
+    Protocol::putle(reqhdr + 4, flags, 4);
+    Protocol::putle(reqhdr + 8, kind, 4);
+    Protocol::putle(reqhdr + 12, displayname.size(), 4);
+    Protocol::putle(reqhdr + 16, payload.size(), 8);
+    if(
+        !Protocol::writeall(sockfd, reqhdr, sizeof(reqhdr)) ||
+        !Protocol::writeall(sockfd, payload.data(), payload.size()) ||
+        !Protocol::writeall(sockfd, displayname.data(), displayname.size())
+    )
+    {
+        complain("cannot send request to", argv[1]);
+        return 1;
+    }
+    if(!Protocol::readall(sockfd, resphdr, sizeof(resphdr)) || (Protocol::getle(resphdr, 4) != Protocol::responsemagic))
+    {
+        std::fprintf(stderr, "rmcppc: no valid response from '%s'\n", argv[1]);
+        return 1;
+    }
+    status = uint32_t(Protocol::getle(resphdr + 4, 4));
+    outlen = Protocol::getle(resphdr + 8, 8);
+    commlen = Protocol::getle(resphdr + 16, 8);
+    msglen = Protocol::getle(resphdr + 24, 8);
+    // output files are only created if there is something to put in them
+    if(status != Protocol::RS_ERROR)
+    {
+        if(outfile != nullptr)
+        {
+            outfd = ::open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(outfd == -1)
+            {
+                complain("cannot open for writing", outfile);
+            }
+        }
+        if(commfile != nullptr)
+        {
+            commfd = ::open(commfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(commfd == -1)
+            {
+                complain("failed to open for writing", commfile);
+            }
+        }
+    }
+    ok = relay(sockfd, outfd, outlen);
+    ok = (relay(sockfd, commfd, commlen) && ok);
+    ok = (relay(sockfd, 2, msglen) && ok);
+    ::close(sockfd);
+    if((outfd != -1) && (outfd != 1))
+    {
+        ok = ((::close(outfd) == 0) && ok);
+    }
+    if(commfd != -1)
+    {
+        ::close(commfd);
+    }
+    return !(ok && (outfd != -1) && (status == Protocol::RS_OK));
+}
@@ -0,0 +1,551 @@
+
+#pragma once
+/*
+* the parser itself, as a template over the comment sink (see CommentStripper::run(SpanWriter&, SinkT&&)).
+* only needs to be included to call that; everything else is in rmcpp.h.
+*/
+
+#include <cassert>
+#include "rmcpp.h"
+#include "stats.h"
+#include "trace.h"
+
+inline void CommentStripper::statbytes(size_t count)
+{
+    (void)count;
+    RMCPP_STAT(
+        if(m_stats != nullptr)
+        {
+            m_stats->statebytes[m_state] += count;
+        }
+    )
+}
+
+inline void CommentStripper::statenter()
+{
+    RMCPP_STAT(
+        if(m_stats != nullptr)
+        {
+            if(m_state == CT_LITERAL)
+            {
+                ((m_quote == '"') ? m_stats->strings : m_stats->chars)++;
+            }
+            else
+            {
+                m_stats->comments[m_state]++;
+            }
+        }
+    )
+}
+
+inline void CommentStripper::statnesting()
+{
+    RMCPP_STAT(
+        if(m_stats != nullptr)
+        {
+            m_stats->maxpascalnest = std::max(m_stats->maxpascalnest, uint64_t(m_pascalnest));
+        }
+    )
+}
+
+inline void CommentStripper::trace(uint8_t kind, State state, uint32_t aux)
+{
+    TraceRing::Record rec;
+    rec.offset = curoffset();
+    if(kind == TraceRing::TR_SKIP)
+    {
+        // curoffset() is the last byte skipped
+        rec.offset -= (aux - 1);
+    }
+    rec.line = uint32_t(m_posline);
+    rec.aux = aux;
+    rec.kind = kind;
+    rec.state = uint8_t(state);
+    rec.nextstate = uint8_t(m_state);
+    rec.byte = uint8_t(m_currch);
+    m_trace->push(rec);
+}
+
+inline void CommentStripper::statinput()
+{
+    RMCPP_STAT(
+        if(m_stats != nullptr)
+        {
+            m_stats->bytesin += (m_inoffset + size_t(m_inend - m_inbegin));
+        }
+    )
+}
+
+template<typename SinkT>
+void CommentStripper::endcomment(SinkT& sink)
+{
+    m_comment.length = ((m_commlast + 1) - m_comment.offset);
+    if(m_infp == nullptr)
+    {
+        m_comment.text = std::string_view(m_inbegin + m_comment.offset, m_comment.length);
+    }
+    else
+    {
+        // m_captured may already hold a byte or two past the end (i.e., the newline)
+        m_comment.text = std::string_view(m_captured.data(), std::min(m_comment.length, m_captured.size()));
+        m_capturing = false;
+    }
+    if(!sink(m_comment))
+    {
+        m_tracking = false;
+    }
+}
+
+template<typename ModeT>
+void CommentStripper::putcode(SpanWriter& out, const char* data, size_t size)
+{
+    if(ModeT::minify(m_opts))
+    {
+        minify(out, data, size);
+        return;
+    }
+    emit(out, data, size);
+}
+
+template<typename ModeT>
+void CommentStripper::putcode(SpanWriter& out, char ch)
+{
+    if(ModeT::minify(m_opts))
+    {
+        minify(out, ch);
+        return;
+    }
+    out.put(ch);
+}
+
+template<typename SinkT, bool... FlagsV>
+bool CommentStripper::dispatch(SpanWriter& out, SinkT& sink)
+{
+    // picks one flag per step, in the order FixedMode takes them
+    constexpr size_t nth = sizeof...(FlagsV);
+    if constexpr(nth == 4)
+    {
+        return runimpl<FixedMode<FlagsV...>>(out, sink);
+    }
+    else
+    {
+        const bool flags[] = {
+            m_opts.remove_hashcomments, m_opts.remove_pascalcomments, m_opts.do_convertcpp, m_opts.do_minify
+        };
+        if(flags[nth])
+        {
+            return dispatch<SinkT, FlagsV..., true>(out, sink);
+        }
+        return dispatch<SinkT, FlagsV..., false>(out, sink);
+    }
+}
+
+template<typename SinkT>
+bool CommentStripper::runmode(SpanWriter& out, SinkT& sink)
+{
+    if(m_opts.use_specialized)
+    {
+        return dispatch<SinkT>(out, sink);
+    }
+    return runimpl<RuntimeMode>(out, sink);
+}
+
+template<typename SinkT>
+bool CommentStripper::runselect(SpanWriter& out, SinkT& sink)
+{
+    bool rc;
+    /*
+    * for --strip, the output goes through a BlankLineFilter on its way to <out>.
+    * not when stripping a chunk, though: ParallelStripper's checkpoints refer to
+    * unfiltered output, so it filters the stitched result instead.
+    */
+    if(m_opts.remove_emptylines && (m_chunk == nullptr))
+    {
+        // a writer that failed once stays failed, so that one is replaced
+        if((m_filtered == nullptr) || !m_filtered->good())
+        {
+            delete m_filtered;
+            delete m_filter;
+            m_filter = new BlankLineFilter;
+            m_filtered = new SpanWriter([this](const char* data, size_t size)
+            {
+                return m_filter->feed(data, size, *m_filterout);
+            });
+        }
+        m_filterout = &out;
+        rc = runmode(*m_filtered, sink);
+        rc = (m_filtered->flush() && rc);
+        m_filter->finish();
+        m_filterout = nullptr;
+        return rc;
+    }
+    return runmode(out, sink);
+}
+
+template<typename SinkT>
+bool CommentStripper::run(SpanWriter& out, SinkT&& sink)
+{
+    bool rc;
+    m_tracking = true;
+    rc = runselect(out, sink);
+    m_tracking = false;
+    statinput();
+    dumptrace();
+    // spans may point into the input, so everything has to be written before returning
+    return (out.flush() && rc);
+}
+
+template<typename ModeT, typename SinkT>
+bool CommentStripper::runimpl(SpanWriter& out, SinkT& sink)
+{
+    int state3Col;
+    bool tracing;
+    State laststate;
+    size_t spanlen;
+    const char* spanbegin;
+    /*
+    * skipped runs are handed to <out> through emit(), which only makes spans of them
+    * when reading from memory. when tracing, a skipped run is recorded as a whole.
+    */
+    tracing = (m_trace != nullptr);
+    state3Col = -99;
+    while(true)
+    {
+        if((m_chunk != nullptr) && (m_currch == '\n'))
+        {
+            if(!chunkpoint(out))
+            {
+                return true;
+            }
+        }
+        /*
+        * skip everything that can't change the current state in one go.
+        * the byte that stopped the scan is then handled as usual below.
+        */
+        spanbegin = m_incur;
+        switch(m_state)
+        {
+            case CT_UNDEF:
+                spanlen = skipahead(m_scancode);
+                putcode<ModeT>(out, spanbegin, spanlen);
+                break;
+            case CT_CPPCOMM:
+            case CT_HASHCOMM:
+                spanlen = skipahead(m_scanline);
+                forward_comment(m_state, spanbegin, spanlen);
+                if(ModeT::convertcpp(m_opts))
+                {
+                    emit(out, spanbegin, spanlen);
+                }
+                if(m_tracking && (spanlen > 0))
+                {
+                    notecomment();
+                }
+                break;
+            case CT_ANSICOMM:
+                spanlen = skipahead(m_scanansi);
+                forward_comment(m_state, spanbegin, spanlen);
+                if(m_tracking && (spanlen > 0))
+                {
+                    notecomment();
+                }
+                break;
+            case CT_PASCALCOMM:
+                spanlen = skipahead(m_scanpascal);
+                forward_comment(m_state, spanbegin, spanlen);
+                if(m_tracking && (spanlen > 0))
+                {
+                    notecomment();
+                }
+                break;
+            case CT_LITERAL:
+                spanlen = skipahead(m_scanliteral);
+                if(spanlen > 0)
+                {
+                    m_escaped = false;
+                    emit(out, spanbegin, spanlen);
+                }
+                break;
+            default:
+                spanlen = 0;
+                break;
+        }
+        statbytes(spanlen);
+        if(tracing && (spanlen > 0))
+        {
+            trace(TraceRing::TR_SKIP, m_state, spanlen);
+        }
+        m_prevch = m_currch;
+        m_currch = more();
+        if(m_currch == EOF)
+        {
+            // unterminated comments are still comments
+            if(m_tracking && m_incomment)
+            {
+                endcomment(sink);
+            }
+            if((m_state == CT_LITERAL) && !ispartial())
+            {
+                warn(RMCPP_FMT("unexpected end-of-file while reading %s literal, starting on line %d, column %d"),
+                    (('"' == m_currch) ? "string" : "char"),
+                    m_litline,
+                    m_litcol
+                );
+                return false;
+            }
+            return true;
+        }
+        statbytes(1);
+        laststate = m_state;
+        switch(m_state)
+        {
+            case CT_UNDEF:
+                if('\'' == m_currch || '"' == m_currch)
+                {
+                    /* Read string literal...
+                       needed to properly catch comments in strings. */
+                    m_state = CT_LITERAL;
+                    m_quote = m_currch;
+                    m_litline = m_posline;
+                    m_litcol = m_poscol;
+                    m_escaped = false;
+                    statenter();
+                    putcode<ModeT>(out, m_currch);
+                    break;
+                }
+                else if('/' == m_currch)
+                {
+                    m_state = CT_FWDSLASH;
+                    if(m_tracking)
+                    {
+                        markcomment(CT_FWDSLASH);
+                    }
+                    break;
+                }
+                else if(ModeT::hashcomments(m_opts) && (m_currch == '#'))
+                {
+                    m_state = CT_HASHCOMM;
+                    m_incomment = true;
+                    statenter();
+                    if(m_tracking)
+                    {
+                        markcomment(m_state);
+                    }
+                    break;
+                }
+                else if(ModeT::pascalcomments(m_opts) && is_pascalcomm_begin())
+                {
+                    if(m_currch == '{')
+                    {
+                        m_pascalbrace = true;
+                    }
+                    m_state = CT_PASCALCOMM;
+                    m_incomment = true;
+                    statenter();
+                    if(m_tracking)
+                    {
+                        markcomment(m_state);
+                    }
+                    break;
+                }
+                putcode<ModeT>(out, m_currch);
+                break;
+            case CT_FWDSLASH: /* 1 slash */
+                /*
+                * huge kludge for odd corner case:
+                */
+                /*/ <--- here.
+                * state3Col marks the source column in which a C-style
+                * comment starts, so that it can tell if star-slash inside a
+                * C-style comment is the end of the comment or is the weird corner
+                * case marked at the start of _this_ comment block.
+                * see also CT_ANSICOMM.
+                */
+                if(('*' == m_currch) && (m_opts.remove_ansicomments == true))
+                {
+                    m_state = CT_ANSICOMM;
+                    m_incomment = true;
+                    statenter();
+                    state3Col = m_poscol - 1;
+                    forward_comment(m_state, "/*");
+                    if(m_tracking)
+                    {
+                        m_comment.kind = m_state;
+                        notecomment();
+                    }
+                    break;
+                }
+                if(('/' == m_currch) && ((m_opts.remove_cppcomments || ModeT::convertcpp(m_opts))))
+                {
+                    m_state = CT_CPPCOMM;
+                    m_incomment = true;
+                    statenter();
+                    if(m_tracking)
+                    {
+                        m_comment.kind = m_state;
+                        notecomment();
+                    }
+                    if(ModeT::convertcpp(m_opts))
+                    {
+                        putcode<ModeT>(out, "/*", 2);
+                    }
+                    else
+                    {
+                        forward_comment(m_state, "//");
+                    }
+                    break;
+                }
+                /* It wasn't a comment after all. */
+                m_state = CT_UNDEF;
+                m_incomment = false;
+                m_capturing = false;
+                putcode<ModeT>(out, m_prevch);
+                putcode<ModeT>(out, m_currch);
+                
+                break;
+            /* C++ comment */
+            case CT_CPPCOMM:
+            case CT_HASHCOMM:
+                forward_comment(m_state, m_currch);
+                if('\n' == m_currch)
+                {
+                    if((m_state == CT_CPPCOMM) && ModeT::convertcpp(m_opts))
+                    {
+                        out.write("*/", 2);
+                    }
+                    m_state = CT_UNDEF;
+                    m_incomment = false;
+                    putcode<ModeT>(out, m_currch);
+                    forward_comment(CT_UNDEF, 0);
+                    if(m_tracking)
+                    {
+                        endcomment(sink);
+                    }
+                    break;
+                }
+                if(m_tracking)
+                {
+                    notecomment();
+                }
+                if(m_incomment && ModeT::convertcpp(m_opts))
+                {
+                    out.put(m_currch);
+                }
+                break;
+            case CT_ANSICOMM: /* C comment */
+                if(tracing)
+                {
+                    trace(TraceRing::TR_BYTE, m_state, 0);
+                }
+                forward_comment(m_state, m_currch);
+                if(m_tracking)
+                {
+                    notecomment();
+                }
+                if('/' == m_currch)
+                {
+                    if('*' == m_prevch)
+                    {
+                        /* Corner case which breaks this: */
+                        /*/ <-- slash there */
+                        /* That shows up twice in a piece of 3rd-party
+                           code i use. */
+                        /* And thus state3Col was introduced :/ */
+                        if(m_poscol != (state3Col + 2))
+                        {
+                            m_incomment = false;
+                            m_state = CT_UNDEF;
+                            state3Col = -99;
+                            forward_comment(CT_UNDEF, 0);
+                            if(m_tracking)
+                            {
+                                endcomment(sink);
+                            }
+                        }
+                    }
+                }
+                break;
+            case CT_PASCALCOMM:
+                if(tracing)
+                {
+                    trace(TraceRing::TR_BYTE, m_state, 0);
+                }
+                forward_comment(m_state, m_currch);
+                if(m_tracking)
+                {
+                    notecomment();
+                }
+                if((('*' == m_prevch) && (')' == m_currch)) || (m_pascalbrace && (m_currch == '}')))
+                {
+                    if(m_pascalnest == 0)
+                    {
+                        if(m_pascalbrace)
+                        {
+                            m_pascalbrace = false;
+                        }
+                        m_incomment = false;
+                        m_state = CT_UNDEF;
+                        forward_comment(m_state, 0);
+                        if(m_tracking)
+                        {
+                            endcomment(sink);
+                        }
+                    }
+                    else
+                    {
+                        if(tracing)
+                        {
+                            trace(TraceRing::TR_UNNEST, m_state, m_pascalnest);
+                        }
+                        warn(RMCPP_FMT("in pascalcomment: unnesting from level %d"), m_pascalnest);
+                        m_pascalnest--;
+                    }
+                }
+                else if((('(' == m_currch) && (m_peekch == '*')) || (m_pascalbrace && (m_currch == '{')))
+                {
+                    m_pascalnest += 1;
+                    statnesting();
+                    if(tracing)
+                    {
+                        trace(TraceRing::TR_NEST, m_state, m_pascalnest);
+                    }
+                    warn(RMCPP_FMT("in pascalcomment: nested comment level %d detected! this may likely break"), m_pascalnest);
+
+                }
+                break;
+            case CT_LITERAL:
+                switch(m_currch)
+                {
+                    case '\\':
+                        m_escaped = !m_escaped;
+                        break;
+                    case '\'':
+                    case '"':
+                        if(!m_escaped && (m_quote == m_currch))
+                        {
+                            m_state = CT_UNDEF;
+                        }
+                        m_escaped = false;
+                        break;
+                    default:
+                        m_escaped = false;
+                        break;
+                }
+                out.put(m_currch);
+                break;
+            default:
+                assert(!"impossible!");
+                break;
+        }
+        if(tracing && (m_state != laststate))
+        {
+            trace(TraceRing::TR_STATE, laststate, 0);
+        }
+        if('\n' == m_currch)
+        {
+            state3Col = -99;
+        }
+    }
+    return true;
+}
+
@@ -0,0 +1,132 @@
+/*
+* CommentIndex - see index.h
+*/
+
+#include <cstdio>
+#include "index.h"
+
+/*
+* appends <value> to <dest> as <nbytes> little-endian bytes.
+* done byte by byte, rather than by copying the struct, so the output is
+* the same on big-endian machines.
+*/
+static void putle(std::string& dest, uint64_t value, size_t nbytes)
+{
+    size_t i;
+    for(i=0; i<nbytes; i++)
+    {
+        dest.push_back(char((value >> (i * 8)) & 0xFF));
+    }
+}
+
+static void putjsonstring(SpanWriter& out, const std::string& str)
+{
+    char buf[8];
+    out.put('"');
+    for(unsigned char ch: str)
+    {
+        if((ch == '"') || (ch == '\\'))
+        {
+            out.put('\\');
+            out.put(ch);
+        }
+        else if(ch < 0x20)
+        {
+            std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out.write(buf, 6);
+        }
+        else
+        {
+            out.put(ch);
+        }
+    }
+    out.put('"');
+}
+
+bool CommentIndex::operator()(const CommentStripper::CommentInfo& ci)
+{
+    Entry ent;
+    ent.begin = ci.offset;
+    ent.end = (ci.offset + ci.length);
+    ent.line = uint32_t(ci.startline);
+    ent.column = uint32_t(ci.startcol);
+    ent.kind = uint32_t(ci.kind);
+    ent.reserved = 0;
+    m_entries.push_back(ent);
+    return true;
+}
+
+bool CommentIndex::writebinary(const std::string& path) const
+{
+    std::string buf;
+    SpanWriter out;
+    if(!out.open(path))
+    {
+        return false;
+    }
+    buf.reserve(sizeof(Header) + (m_entries.size() * sizeof(Entry)));
+    buf.append(magic, sizeof(magic));
+    putle(buf, version, 4);
+    putle(buf, sizeof(Entry), 4);
+    putle(buf, m_entries.size(), 8);
+    putle(buf, 0, 8);
+    for(const auto& ent: m_entries)
+    {
+        putle(buf, ent.begin, 8);
+        putle(buf, ent.end, 8);
+        putle(buf, ent.line, 4);
+        putle(buf, ent.column, 4);
+        putle(buf, ent.kind, 4);
+        putle(buf, 0, 4);
+    }
+    out.span(buf.data(), buf.size());
+    return out.flush();
+}
+
+bool CommentIndex::writejson(const std::string& path, const std::string& infilename) const
+{
+    int len;
+    size_t i;
+    char buf[128];
+    SpanWriter out;
+    if(!out.open(path))
+    {
+        return false;
+    }
+    out.write("{\"file\": ", 9);
+    putjsonstring(out, infilename);
+    out.write(", \"comments\": [", 15);
+    for(i=0; i<m_entries.size(); i++)
+    {
+        const Entry& ent = m_entries[i];
+        len = std::snprintf(buf, sizeof(buf), "%s\n  {\"kind\": \"%s\", \"begin\": %llu, \"end\": %llu, \"line\": %u, \"column\": %u}",
+            ((i == 0) ? "" : ","),
+            kindname(ent.kind),
+            (unsigned long long)ent.begin,
+            (unsigned long long)ent.end,
+            (unsigned)ent.line,
+            (unsigned)ent.column
+        );
+        out.write(buf, len);
+    }
+    out.write("\n]}\n", 4);
+    return out.flush();
+}
+
+const char* CommentIndex::kindname(uint32_t kind)
+{
+    switch(kind)
+    {
+        case CommentStripper::CT_CPPCOMM:
+            return "cpp";
+        case CommentStripper::CT_ANSICOMM:
+            return "ansi";
+        case CommentStripper::CT_PASCALCOMM:
+            return "pascal";
+        case CommentStripper::CT_HASHCOMM:
+            return "hash";
+        default:
+            break;
+    }
+    return "unknown";
+}
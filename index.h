@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include "rmcpp.h"
+
+/*
+* a list of every comment in a file, collected while stripping it.
+*
+* the binary format is meant to be mmap'd and used as-is. all integers are
+* little-endian, regardless of the machine that wrote the file:
+*
+*   offset  size  what
+*        0     8  magic, "RMCPPIDX"
+*        8     4  format version (currently 1)
+*       12     4  size of one entry in bytes (currently 32)
+*       16     8  number of entries
+*       24     8  reserved, always 0
+*       32     -  the entries, in the order the comments appear in the input
+*
+* every entry is laid out as CommentIndex::Entry:
+*
+*        0     8  offset of the first byte of the comment
+*        8     8  offset just past its last byte
+*       16     4  line of the first byte
+*       20     4  column of the first byte
+*       24     4  kind: the value of CommentStripper::State (CT_CPPCOMM, CT_ANSICOMM, ...)
+*       28     4  reserved, always 0
+*
+* readers should skip <entrysize> bytes per entry, so that fields can be appended later.
+*/
+class CommentIndex
+{
+    public:
+        static constexpr char magic[8] = {'R', 'M', 'C', 'P', 'P', 'I', 'D', 'X'};
+        static constexpr uint32_t version = 1;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t entrysize;
+            uint64_t count;
+            uint64_t reserved;
+        };
+
+        struct Entry
+        {
+            uint64_t begin;
+            uint64_t end;
+            uint32_t line;
+            uint32_t column;
+            uint32_t kind;
+            uint32_t reserved;
+        };
+
+        static_assert(sizeof(Header) == 32, "index header must be 32 bytes");
+        static_assert(sizeof(Entry) == 32, "index entry must be 32 bytes");
+
+    private:
+        std::vector<Entry> m_entries;
+
+    public:
+        /*
+        * records <ci>. this makes CommentIndex usable as the sink for
+        * CommentStripper::run(SpanWriter&, SinkT&&), i.e.:
+        *
+        *   CommentIndex idx;
+        *   cs.run(out, idx);
+        */
+        bool operator()(const CommentStripper::CommentInfo& ci);
+
+        const std::vector<Entry>& entries() const
+        {
+            return m_entries;
+        }
+
+        /**
+        * writes the binary index to <path>.
+        * @returns false if the file could not be written.
+        */
+        bool writebinary(const std::string& path) const;
+
+        /**
+        * writes the index as JSON to <path>. <infilename> is recorded as the "file" field.
+        * @returns false if the file could not be written.
+        */
+        bool writejson(const std::string& path, const std::string& infilename) const;
+
+        /**
+        * @returns the name used for <kind> in the JSON output, i.e., "ansi" for CT_ANSICOMM.
+        */
+        static const char* kindname(uint32_t kind);
+};
@@ -23,7 +23,118 @@
 */
 
 #include <cassert>
+#include <iterator>
+#if !defined(_WIN32)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
 #include "rmcpp.h"
+#include "engine.h"
+#include "trace.h"
+
+MappedFile::MappedFile(): m_data(""), m_size(0), m_ismapped(false), m_fd(-1)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    release();
+}
+
+void MappedFile::release()
+{
+    #if !defined(_WIN32)
+    if(m_ismapped)
+    {
+        munmap((void*)m_data, m_size);
+        ::close(m_fd);
+    }
+    #endif
+    m_data = "";
+    m_size = 0;
+    m_ismapped = false;
+    m_fd = -1;
+    m_fallback.clear();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    release();
+    #if !defined(_WIN32)
+    {
+        int fd;
+        void* ptr;
+        struct stat st;
+        fd = ::open(path.c_str(), O_RDONLY);
+        if(fd == -1)
+        {
+            return false;
+        }
+        if(fstat(fd, &st) == -1)
+        {
+            ::close(fd);
+            return false;
+        }
+        /*
+        * only regular files can be mapped - anything else (pipes, devices, ...)
+        * is read the slow way below.
+        * empty files can't be mapped either, but there's nothing to read anyway.
+        */
+        if(S_ISREG(st.st_mode))
+        {
+            if(st.st_size > 0)
+            {
+                ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(ptr == MAP_FAILED)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+                m_data = (const char*)ptr;
+                m_size = st.st_size;
+                m_ismapped = true;
+                m_fd = fd;
+                return true;
+            }
+            ::close(fd);
+            return true;
+        }
+        ::close(fd);
+    }
+    #endif
+    {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if(!ifs.good())
+        {
+            return false;
+        }
+        m_fallback.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        m_data = m_fallback.data();
+        m_size = m_fallback.size();
+    }
+    return true;
+}
+
+std::string CommentStripper::Options::serialize() const
+{
+    std::string res;
+    // bump the version whenever the output for the same options changes
+    res = "rmcpp2:";
+    res += (use_warningmessages ? 'W' : 'w');
+    res += (use_debugmessages ? 'D' : 'd');
+    res += (remove_emptylines ? 'S' : 's');
+    res += (remove_cppcomments ? 'C' : 'c');
+    res += (remove_ansicomments ? 'A' : 'a');
+    res += (remove_pascalcomments ? 'P' : 'p');
+    res += (remove_hashcomments ? 'H' : 'h');
+    res += (do_convertcpp ? 'X' : 'x');
+    res += (do_minify ? 'M' : 'm');
+    res += (minify_dropindent ? 'I' : 'i');
+    return res;
+}
 
 void CommentStripper::initdefaults()
 {
@@ -36,35 +147,161 @@ void CommentStripper::initdefaults()
     m_pascalnest = 0;
     m_pascalbrace = false;
     m_incomment = false;
+    m_quote = 0;
+    m_escaped = false;
+    m_litline = 0;
+    m_litcol = 0;
+    m_minspace = false;
+    m_minline = true;
+    m_chunk = nullptr;
+    m_tracking = false;
+    m_comment = CommentInfo();
+    m_commlast = 0;
+    m_capturing = false;
+    m_inoffset = 0;
+    m_ineof = false;
+    m_stats = nullptr;
+    m_trace = nullptr;
+    if(m_opts.use_debugmessages)
+    {
+        m_trace = new TraceRing;
+        m_trace->enable();
+    }
 }
 
-bool CommentStripper::is_space()
+void CommentStripper::initscanner()
 {
-    if(m_currch == '\n')
+    // the most m_scancode ever gets (with both --hash and --pascal); any more, and it's scalar only
+    static_assert(Scan::ByteSet::maxchars >= 8, "m_scancode does not fit in a Scan::ByteSet");
+    m_findfn = Scan::findfunc();
+    /*
+    * '\n' and '\r' are in every set: more() skips carriage returns and counts
+    * lines, and that is simpler to leave to more() than to replicate here.
+    */
+    m_scancode.add('\n');
+    m_scancode.add('\r');
+    m_scancode.add('"');
+    m_scancode.add('\'');
+    m_scancode.add('/');
+    if(m_opts.remove_hashcomments)
     {
-        if((m_peekch == '\r') || (m_peekch == '\n'))
-        {
-            return true;
-        }
-        return false;
+        m_scancode.add('#');
     }
-    return (
-        (m_currch == ' ') ||
-        (m_currch == '\t')
-    );
+    if(m_opts.remove_pascalcomments)
+    {
+        m_scancode.add('(');
+        m_scancode.add('{');
+    }
+    /*
+    * a C comment can only end at a slash (if preceded by a star), so unlike what one
+    * might expect, the star itself isn't interesting: skipahead() keeps m_prevch intact.
+    * doc-comments tend to have a lot more stars than slashes, too.
+    */
+    m_scanansi.add('\n');
+    m_scanansi.add('\r');
+    m_scanansi.add('/');
+    m_scanline.add('\n');
+    m_scanline.add('\r');
+    // same for '*)': the closing parenthesis is enough
+    m_scanpascal.add('\n');
+    m_scanpascal.add('\r');
+    m_scanpascal.add('(');
+    m_scanpascal.add(')');
+    m_scanpascal.add('{');
+    m_scanpascal.add('}');
+    m_scanliteral.add('\n');
+    m_scanliteral.add('\r');
+    m_scanliteral.add('\\');
+    m_scanliteral.add('"');
+    m_scanliteral.add('\'');
+    m_skipfn = Scan::skipfunc();
+    m_scanspace.add(' ');
+    m_scanspace.add('\t');
+    m_scanspace.add('\v');
+    m_scanspace.add('\f');
 }
 
-void CommentStripper::do_skipemptylines()
+bool CommentStripper::isverbatim(const Options& opts, const char* data, size_t size)
 {
+    int quote;
+    const char* cur;
+    const char* end;
+    Scan::FindFunc findfn;
+    Scan::ByteSet code;
+    Scan::ByteSet dquoted;
+    Scan::ByteSet squoted;
+    // removing empty lines or whitespace changes the output without any comments at all
+    if(opts.remove_emptylines || opts.do_minify)
+    {
+        return false;
+    }
+    findfn = Scan::findfunc();
+    // same as m_scancode, except for '\n', which doesn't matter here
+    code.add('\r');
+    code.add('"');
+    code.add('\'');
+    code.add('/');
+    if(opts.remove_hashcomments)
+    {
+        code.add('#');
+    }
+    if(opts.remove_pascalcomments)
+    {
+        code.add('(');
+        code.add('{');
+    }
+    dquoted.add('\r');
+    dquoted.add('\\');
+    dquoted.add('"');
+    squoted.add('\r');
+    squoted.add('\\');
+    squoted.add('\'');
+    cur = data;
+    end = (data + size);
     while(true)
     {
-        if((m_currch == '\n') && ((m_peekch == '\r') || (m_peekch == '\n')))
+        cur = findfn(cur, end, code);
+        if(cur == end)
         {
-            m_currch = more();
+            return true;
         }
-        else
+        // only '(*' starts a comment
+        if(*cur == '(')
         {
-            return;
+            if(((cur + 1) < end) && (cur[1] == '*'))
+            {
+                return false;
+            }
+            cur++;
+            continue;
+        }
+        if((*cur != '"') && (*cur != '\''))
+        {
+            return false;
+        }
+        // a literal, in which anything goes, up to the matching unescaped quote
+        quote = *cur;
+        cur++;
+        while(true)
+        {
+            cur = findfn(cur, end, ((quote == '"') ? dquoted : squoted));
+            if((cur == end) || (*cur == '\r'))
+            {
+                // run() warns about the former
+                return false;
+            }
+            // whatever follows a backslash is part of the literal
+            if(*cur == '\\')
+            {
+                if(((end - cur) < 2) || (cur[1] == '\r'))
+                {
+                    return false;
+                }
+                cur += 2;
+                continue;
+            }
+            cur++;
+            break;
         }
     }
 }
@@ -90,18 +327,123 @@ bool CommentStripper::is_pascalcomm_begin()
 }
 
 CommentStripper::CommentStripper(const Options& opts, std::istream* infp):
-    m_opts(opts), m_infp(infp)
+    m_opts(opts), m_infp(infp), m_inbegin(nullptr), m_incur(nullptr), m_inend(nullptr), m_diagfp(&std::cerr),
+    m_filter(nullptr), m_filtered(nullptr), m_filterout(nullptr)
+{
+    initdefaults();
+    initscanner();
+}
+
+CommentStripper::CommentStripper(const Options& opts, const char* data, size_t size):
+    m_opts(opts), m_infp(nullptr), m_inbegin(data), m_incur(data), m_inend(data + size), m_diagfp(&std::cerr),
+    m_filter(nullptr), m_filtered(nullptr), m_filterout(nullptr)
+{
+    initdefaults();
+    initscanner();
+}
+
+CommentStripper::~CommentStripper()
 {
+    delete m_trace;
+    delete m_filtered;
+    delete m_filter;
+}
+
+void CommentStripper::reset(const char* data, size_t size)
+{
+    StripStats* stats;
+    // initdefaults() sets up a new trace, if need be, and forgets about stats
+    stats = m_stats;
+    delete m_trace;
+    m_infp = nullptr;
+    m_inbegin = data;
+    m_incur = data;
+    m_inend = (data + size);
     initdefaults();
+    m_stats = stats;
+}
+
+const char* CommentStripper::statename(State st)
+{
+    switch(st)
+    {
+        case CT_UNDEF:
+            return "undef";
+        case CT_WHITESPACE:
+            return "whitespace";
+        case CT_FWDSLASH:
+            return "fwdslash";
+        case CT_BCKSLASH:
+            return "bckslash";
+        case CT_OPENPAREN:
+            return "openparen";
+        case CT_CLOSEPAREN:
+            return "closeparen";
+        case CT_PREPROC:
+            return "preproc";
+        case CT_CPPCOMM:
+            return "cppcomment";
+        case CT_ANSICOMM:
+            return "ansicomment";
+        case CT_PASCALCOMM:
+            return "pascalcomment";
+        case CT_HASHCOMM:
+            return "hashcomment";
+        case CT_LITERAL:
+            return "literal";
+    }
+    return "???";
+}
+
+void CommentStripper::dumptrace()
+{
+    if(m_trace != nullptr)
+    {
+        m_trace->dump(*m_diagfp, m_opts.infilename);
+    }
+}
+
+bool CommentStripper::refill()
+{
+    if(m_ineof)
+    {
+        return false;
+    }
+    if(m_inbuf.empty())
+    {
+        m_inbuf.resize(streambufsize);
+    }
+    m_inoffset += (m_inend - m_inbegin);
+    m_infp->read(m_inbuf.data(), m_inbuf.size());
+    m_inbegin = m_inbuf.data();
+    m_incur = m_inbegin;
+    m_inend = (m_inbegin + m_infp->gcount());
+    if(m_incur == m_inend)
+    {
+        m_ineof = true;
+        return false;
+    }
+    return true;
 }
 
 int CommentStripper::more()
 {
     // store previous character
     m_prevch = m_currch;
-    // get current character
-    m_currch = m_infp->get();
-    // store next character, without advancing stream
+    // get current character, and the next one, straight from memory - after refilling it, if need be
+    m_currch = EOF;
+    if((m_incur == m_inend) && (m_infp != nullptr))
+    {
+        refill();
+    }
+    if(m_incur < m_inend)
+    {
+        m_currch = (unsigned char)*m_incur++;
+        if(m_capturing)
+        {
+            m_captured.push_back(char(m_currch));
+        }
+    }
     m_peekch = peek();
     // ignore carriage returns
     if(m_currch == '\r')
@@ -119,7 +461,19 @@ int CommentStripper::more()
 
 int CommentStripper::peek()
 {
-    return m_infp->peek();
+    /*
+    * the next byte may well be in the next block of the stream.
+    * m_currch is already a copy, so nothing is lost by refilling.
+    */
+    if((m_incur == m_inend) && (m_infp != nullptr))
+    {
+        refill();
+    }
+    if(m_incur < m_inend)
+    {
+        return (unsigned char)*m_incur;
+    }
+    return EOF;
 }
 
 void CommentStripper::forward_comment(State st, char ch)
@@ -141,239 +495,277 @@ void CommentStripper::forward_comment(State st, const std::string& str)
     }
 }
 
-void CommentStripper::onComment(OnCommentCallback cb)
+void CommentStripper::forward_comment(State st, const char* str, size_t len)
 {
-    m_oncommentcb = cb;
+    size_t i;
+    for(i=0; (i<len) && m_oncommentcb; i++)
+    {
+        forward_comment(st, str[i]);
+    }
 }
 
-bool CommentStripper::run(std::ostream& outfp)
+size_t CommentStripper::skipahead(const Scan::ByteSet& set)
 {
-    int quote;
-    int morech;
-    int state3Col;
-    long startLine;
-    long startCol;
-    bool escaped;
-    bool endOfString;
-    state3Col = -99;
-    while(true)
+    size_t count;
+    const char* stop;
+    stop = m_findfn(m_incur, m_inend, set);
+    count = (stop - m_incur);
+    if(count > 0)
     {
-        m_prevch = m_currch;
-        m_currch = more();
-        if(m_currch == EOF)
+        if(count > 1)
         {
-            return true;
+            m_prevch = (unsigned char)stop[-2];
         }
-        switch(m_state)
+        else
         {
-            case CT_UNDEF:
-                if('\'' == m_currch || '"' == m_currch)
-                {
-                    /* Read string literal...
-                       needed to properly catch comments in strings. */
-                    quote = m_currch;
-                    startLine = m_posline;
-                    startCol = m_poscol;
-                    escaped = false;
-                    endOfString = false;
-                    outfp.put(m_currch);
-                    while(true)
-                    {
-                        if(endOfString == true)
-                        {
-                            break;
-                        }
-                        morech = more();
-                        if(morech == EOF)
-                        {
-                            break;
-                        }
-                        switch(morech)
-                        {
-                            case '\\':
-                                escaped = !escaped;
-                                break;
-                            case '\'':
-                            case '"':
-                                if(!escaped && quote == morech)
-                                {
-                                    endOfString = true;
-                                }
-                                escaped = false;
-                                break;
-                            default:
-                                escaped = false;
-                                break;
-                        }
-                        outfp.put(morech);
-                    }
-                    if(EOF == morech)
-                    {
-                        warn("unexpected end-of-file while reading %s literal, starting on line %d, column %d",
-                            (('"' == m_currch) ? "string" : "char"),
-                            startLine,
-                            startCol
-                        );
-                        return false;
-                    }
-                    break;
-                }
-                else if('/' == m_currch)
-                {
-                    m_state = CT_FWDSLASH;
-                    break;
-                }
-                else if(m_opts.remove_hashcomments && (m_currch == '#'))
-                {
-                    m_state = CT_HASHCOMM;
-                    m_incomment = true;
-                    break;
-                }
-                else if(m_opts.remove_pascalcomments && is_pascalcomm_begin())
-                {
-                    dbg("begin pascalcomment");
-                    if(m_currch == '{')
-                    {
-                        m_pascalbrace = true;
-                    }
-                    m_state = CT_PASCALCOMM;
-                    m_incomment = true;
-                    break;
-                }
-                else if(is_space() && m_opts.remove_emptylines)
-                {
-                    do_skipemptylines();
-                    if(m_currch == EOF)
-                    {
-                        return false;
-                    }
-                }
-                else
-                {
-                    dbg("???how did we end up here???");
-                }
-                outfp.put(m_currch);
-                break;
-            case CT_FWDSLASH: /* 1 slash */
-                /*
-                * huge kludge for odd corner case:
-                */
-                /*/ <--- here.
-                * state3Col marks the source column in which a C-style
-                * comment starts, so that it can tell if star-slash inside a
-                * C-style comment is the end of the comment or is the weird corner
-                * case marked at the start of _this_ comment block.
-                * see also CT_ANSICOMM.
-                */
-                if(('*' == m_currch) && (m_opts.remove_ansicomments == true))
-                {
-                    m_state = CT_ANSICOMM;
-                    m_incomment = true;
-                    state3Col = m_poscol - 1;
-                    forward_comment(m_state, "/*");
-                    break;
-                }
-                if(('/' == m_currch) && ((m_opts.remove_cppcomments || m_opts.do_convertcpp)))
-                {
-                    m_state = CT_CPPCOMM;
-                    m_incomment = true;
-                    if(m_opts.do_convertcpp)
-                    {
-                        outfp << "/*";
-                    }
-                    else
-                    {
-                        forward_comment(m_state, "//");
-                    }
-                    break;
-                }
-                /* It wasn't a comment after all. */
-                m_state = CT_UNDEF;
-                m_incomment = false;
-                outfp.put(m_prevch);
-                outfp.put(m_currch);
-                
-                break;
-            /* C++ comment */
-            case CT_CPPCOMM:
-            case CT_HASHCOMM:
-                forward_comment(m_state, m_currch);
-                if('\n' == m_currch)
-                {
-                    if((m_state == CT_CPPCOMM) && (m_opts.do_convertcpp == true))
-                    {
-                        outfp << "*/";
-                    }
-                    m_state = CT_UNDEF;
-                    m_incomment = false;
-                    outfp.put(m_currch);
-                    forward_comment(CT_UNDEF, 0);
-                }
-                else if(m_incomment && m_opts.do_convertcpp)
-                {
-                    outfp.put(m_currch);
-                }
-                break;
-            case CT_ANSICOMM: /* C comment */
-                dbg("in ansicomment: currch=%q", char(m_currch));
-                forward_comment(m_state, m_currch);
-                if('/' == m_currch)
-                {
-                    if('*' == m_prevch)
-                    {
-                        /* Corner case which breaks this: */
-                        /*/ <-- slash there */
-                        /* That shows up twice in a piece of 3rd-party
-                           code i use. */
-                        /* And thus state3Col was introduced :/ */
-                        if(m_poscol != (state3Col + 2))
-                        {
-                            m_incomment = false;
-                            m_state = CT_UNDEF;
-                            state3Col = -99;
-                            forward_comment(CT_UNDEF, 0);
-                        }
-                    }
-                }
-                break;
-            case CT_PASCALCOMM:
-                dbg("in pascalcomment: currch=%q", char(m_currch));
-                forward_comment(m_state, m_currch);
-                if((('*' == m_prevch) && (')' == m_currch)) || (m_pascalbrace && (m_currch == '}')))
-                {
-                    if(m_pascalnest == 0)
-                    {
-                        if(m_pascalbrace)
-                        {
-                            m_pascalbrace = false;
-                        }
-                        dbg("end pascalcomment");
-                        m_incomment = false;
-                        m_state = CT_UNDEF;
-                        forward_comment(m_state, 0);
-                    }
-                    else
-                    {
-                        warn("in pascalcomment: unnesting from level %d", m_pascalnest);
-                        m_pascalnest--;
-                    }
-                }
-                else if((('(' == m_currch) && (m_peekch == '*')) || (m_pascalbrace && (m_currch == '{')))
-                {
-                    m_pascalnest += 1;
-                    warn("in pascalcomment: nested comment level %d detected! this may likely break", m_pascalnest);
+            m_prevch = m_currch;
+        }
+        m_currch = (unsigned char)stop[-1];
+        m_poscol += count;
+        if(m_capturing)
+        {
+            m_captured.append(m_incur, count);
+        }
+        m_incur = stop;
+        /*
+        * not peek(): refilling m_inbuf now would pull the skipped bytes out from under
+        * the caller. at the end of m_inbuf, this is EOF for now; more() is next anyway.
+        */
+        m_peekch = ((stop < m_inend) ? (unsigned char)*stop : EOF);
+    }
+    return count;
+}
 
-                }
-                break;
-            default:
-                assert(!"impossible!");
-                break;
+void CommentStripper::minify(SpanWriter& out, const char* data, size_t size)
+{
+    const char* cur;
+    const char* end;
+    const char* run;
+    /*
+    * code rarely goes on for more than a few bytes without a space, so a plain loop
+    * does better here than the scan kernels.
+    */
+    cur = data;
+    end = (data + size);
+    while(cur < end)
+    {
+        run = cur;
+        while((cur < end) && !m_scanspace.table[(unsigned char)*cur])
+        {
+            cur++;
+        }
+        if(cur > run)
+        {
+            minifyflush(out);
+            emit(out, run, (cur - run));
+            m_minline = false;
+        }
+        if(cur == end)
+        {
+            break;
+        }
+        while((cur < end) && m_scanspace.table[(unsigned char)*cur])
+        {
+            cur++;
+        }
+        // indentation is either dropped right here, or ends up as one space like any other run
+        m_minspace = !(m_minline && m_opts.minify_dropindent);
+    }
+}
+
+void CommentStripper::minify(SpanWriter& out, char ch)
+{
+    switch(ch)
+    {
+        case ' ':
+        case '\t':
+        case '\v':
+        case '\f':
+            m_minspace = !(m_minline && m_opts.minify_dropindent);
+            break;
+        case '\n':
+            // whitespace at the end of a line goes
+            m_minspace = false;
+            m_minline = true;
+            out.put(ch);
+            break;
+        default:
+            minifyflush(out);
+            m_minline = false;
+            out.put(ch);
+            break;
+    }
+}
+
+bool CommentStripper::Snapshot::operator==(const Snapshot& other) const
+{
+    if((state != other.state) || (pascalnest != other.pascalnest) || (pascalbrace != other.pascalbrace) || (incomment != other.incomment))
+    {
+        return false;
+    }
+    if((minspace != other.minspace) || (minline != other.minline))
+    {
+        return false;
+    }
+    if(state == CT_LITERAL)
+    {
+        return (
+            (quote == other.quote) &&
+            (escaped == other.escaped) &&
+            (litline == other.litline) &&
+            (litcol == other.litcol)
+        );
+    }
+    return true;
+}
+
+CommentStripper::Snapshot CommentStripper::snapshot() const
+{
+    Snapshot snap;
+    snap.state = m_state;
+    snap.pascalnest = m_pascalnest;
+    snap.pascalbrace = m_pascalbrace;
+    snap.incomment = m_incomment;
+    snap.quote = m_quote;
+    snap.escaped = m_escaped;
+    snap.litline = m_litline;
+    snap.litcol = m_litcol;
+    snap.minspace = m_minspace;
+    snap.minline = m_minline;
+    return snap;
+}
+
+void CommentStripper::beginchunk(const char* begin, const char* end, long line, const Snapshot& snap, ChunkControl* ctl)
+{
+    /*
+    * the very first chunk starts wherever initdefaults() says it does.
+    * every other chunk starts right after a '\n'; at that point the column
+    * is always 1, and the only thing that matters about the previous character is
+    * that it was a '\n'.
+    */
+    if(begin != m_inbegin)
+    {
+        m_prevch = '\n';
+        m_currch = '\n';
+        m_posline = line;
+        m_poscol = 1;
+    }
+    m_incur = begin;
+    m_inend = end;
+    m_peekch = peek();
+    m_state = snap.state;
+    m_pascalnest = snap.pascalnest;
+    m_pascalbrace = snap.pascalbrace;
+    m_incomment = snap.incomment;
+    m_quote = snap.quote;
+    m_escaped = snap.escaped;
+    m_litline = snap.litline;
+    m_litcol = snap.litcol;
+    m_minspace = snap.minspace;
+    m_minline = snap.minline;
+    m_chunk = ctl;
+    m_chunk->startoffset = (begin - m_inbegin);
+}
+
+bool CommentStripper::chunkpoint(SpanWriter& out)
+{
+    size_t offset;
+    Checkpoint cp;
+    ChunkControl* ctl;
+    ctl = m_chunk;
+    offset = (m_incur - m_inbegin);
+    if(ctl->match != nullptr)
+    {
+        const std::vector<Checkpoint>& cps = *(ctl->match);
+        while((ctl->matchidx < cps.size()) && (cps[ctl->matchidx].offset < offset))
+        {
+            ctl->matchidx++;
+        }
+        if((ctl->matchidx < cps.size()) && (cps[ctl->matchidx].offset == offset) && (cps[ctl->matchidx].snap == snapshot()))
+        {
+            ctl->converged = ctl->matchidx;
+            return false;
         }
-        if('\n' == m_currch)
+        if((ctl->budget > 0) && ((offset - ctl->startoffset) > ctl->budget))
+        {
+            ctl->gaveup = true;
+            return false;
+        }
+    }
+    if(ctl->record != nullptr)
+    {
+        if(ctl->record->empty() || ((offset - ctl->lastrecord) >= ctl->interval))
         {
-            state3Col = -99;
+            cp.offset = offset;
+            cp.snap = snapshot();
+            cp.outlen = out.tell();
+            cp.diaglen = 0;
+            if(ctl->diagfp != nullptr)
+            {
+                cp.diaglen = size_t(ctl->diagfp->tellp());
+            }
+            ctl->record->push_back(cp);
+            ctl->lastrecord = offset;
         }
     }
     return true;
 }
 
+void CommentStripper::markcomment(State kind)
+{
+    m_comment.kind = kind;
+    m_comment.offset = curoffset();
+    m_comment.startline = m_posline;
+    m_comment.startcol = curcolumn();
+    notecomment();
+    if(m_infp != nullptr)
+    {
+        m_captured.assign(1, char(m_currch));
+        m_capturing = true;
+    }
+}
+
+void CommentStripper::onComment(OnCommentCallback cb)
+{
+    m_oncommentcb = cb;
+}
+
+void CommentStripper::onCommentRange(OnCommentRangeCallback cb)
+{
+    m_oncommentrangecb = cb;
+}
+
+void CommentStripper::setDiagStream(std::ostream* fp)
+{
+    m_diagfp = fp;
+}
+
+void CommentStripper::setStats(StripStats* stats)
+{
+    m_stats = stats;
+}
+
+bool CommentStripper::run(std::ostream& outfp)
+{
+    SpanWriter out(outfp);
+    return run(out);
+}
+
+bool CommentStripper::run(SpanWriter& out)
+{
+    if(m_oncommentrangecb)
+    {
+        return run(out, m_oncommentrangecb);
+    }
+    bool rc;
+    // never called, since m_tracking stays false
+    auto nosink = [](const CommentInfo&)
+    {
+        return true;
+    };
+    rc = runselect(out, nosink);
+    statinput();
+    dumptrace();
+    // spans may point into the input, so everything has to be written before returning
+    return (out.flush() && rc);
+}
@@ -0,0 +1,310 @@
+/*
+* ParallelStripper - see rmcpp.h
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include "rmcpp.h"
+
+struct ParallelStripper::Run
+{
+    // false if this run gave up before converging or reaching the end of its chunk
+    bool valid = false;
+
+    // what CommentStripper::run() returned
+    bool rc = true;
+
+    std::string output;
+    std::string diag;
+
+    // index of the primary run's checkpoint this run converged with, or -1
+    long converged = -1;
+
+    CommentStripper::Snapshot entry;
+    CommentStripper::Snapshot exit;
+};
+
+struct ParallelStripper::Chunk
+{
+    size_t begin;
+    size_t end;
+    // line number at <begin>
+    long line;
+    bool islast;
+    // recorded by the primary run
+    std::vector<CommentStripper::Checkpoint> checkpoints;
+    // the run that assumes the chunk starts outside of any comment
+    Run primary;
+    // runs from every other plausible starting state
+    std::vector<Run> alternates;
+};
+
+ParallelStripper::ParallelStripper(const CommentStripper::Options& opts, const char* data, size_t size, size_t nthreads):
+    m_opts(opts), m_data(data), m_size(size), m_nthreads(nthreads), m_diagfp(&std::cerr)
+{
+    if(m_nthreads == 0)
+    {
+        m_nthreads = std::thread::hardware_concurrency();
+        if(m_nthreads == 0)
+        {
+            m_nthreads = 1;
+        }
+    }
+}
+
+void ParallelStripper::setDiagStream(std::ostream* fp)
+{
+    m_diagfp = fp;
+}
+
+void ParallelStripper::splitchunks(std::vector<Chunk>& chunks)
+{
+    size_t i;
+    size_t pos;
+    size_t nominal;
+    size_t nchunks;
+    size_t target;
+    long line;
+    const char* nl;
+    const char* scan;
+    Chunk ck;
+    /* a few more chunks than threads, so one slow chunk doesn't stall everything */
+    nchunks = std::min(m_nthreads * 4, std::max(m_size / minchunksize, size_t(1)));
+    target = (m_size / nchunks);
+    pos = 0;
+    line = 1;
+    ck.islast = false;
+    for(i=1; i<nchunks; i++)
+    {
+        nominal = (i * target);
+        if(nominal <= pos)
+        {
+            continue;
+        }
+        /*
+        * chunks end right after a '\n' that isn't followed by another '\n' or '\r'.
+        * that way, a chunk never starts with a carriage return (which more() skips),
+        * or in the middle of a run of line breaks.
+        */
+        scan = m_data + nominal;
+        while(true)
+        {
+            nl = (const char*)std::memchr(scan, '\n', (m_data + m_size) - scan);
+            if((nl == nullptr) || ((nl + 1) >= (m_data + m_size)))
+            {
+                nl = nullptr;
+                break;
+            }
+            if((nl[1] != '\n') && (nl[1] != '\r'))
+            {
+                break;
+            }
+            scan = nl + 1;
+        }
+        if(nl == nullptr)
+        {
+            break;
+        }
+        ck.begin = pos;
+        ck.end = (nl + 1) - m_data;
+        ck.line = line;
+        chunks.push_back(ck);
+        line += std::count(m_data + ck.begin, m_data + ck.end, '\n');
+        pos = ck.end;
+    }
+    ck.begin = pos;
+    ck.end = m_size;
+    ck.line = line;
+    ck.islast = true;
+    chunks.push_back(ck);
+}
+
+bool ParallelStripper::runone(Chunk& ck, Run& rn, const CommentStripper::Snapshot& entry, bool primary, size_t budget)
+{
+    std::ostringstream diag;
+    CommentStripper::ChunkControl ctl;
+    CommentStripper cs(m_opts, m_data, m_size);
+    cs.setDiagStream(&diag);
+    ctl.islast = ck.islast;
+    ctl.diagfp = &diag;
+    if(primary)
+    {
+        ctl.record = &ck.checkpoints;
+        ctl.interval = checkpointinterval;
+    }
+    else
+    {
+        ctl.match = &ck.checkpoints;
+        ctl.budget = budget;
+    }
+    cs.beginchunk(m_data + ck.begin, m_data + ck.end, ck.line, entry, &ctl);
+    {
+        SpanWriter out(rn.output);
+        rn.rc = cs.run(out);
+    }
+    rn.diag = diag.str();
+    rn.entry = entry;
+    rn.exit = cs.snapshot();
+    rn.converged = ctl.converged;
+    rn.valid = !ctl.gaveup;
+    return rn.valid;
+}
+
+void ParallelStripper::runchunk(Chunk& ck)
+{
+    std::vector<CommentStripper::Snapshot> entries;
+    size_t i;
+    size_t n;
+    CommentStripper::Snapshot snap;
+    runone(ck, ck.primary, CommentStripper::Snapshot(), true, 0);
+    if(ck.begin == 0)
+    {
+        // the first chunk's starting state is known, nothing to speculate about
+        return;
+    }
+    /*
+    * the other states a line can plausibly start in.
+    * CT_CPPCOMM and CT_HASHCOMM always end at a newline, and CT_FWDSLASH can't span one.
+    * literals and nested pascal comments can, but they're rare enough that it's cheaper
+    * to just redo the chunk if it happens (see run()).
+    */
+    snap.incomment = true;
+    if(m_opts.remove_ansicomments)
+    {
+        snap.state = CommentStripper::CT_ANSICOMM;
+        entries.push_back(snap);
+    }
+    if(m_opts.remove_pascalcomments)
+    {
+        snap.state = CommentStripper::CT_PASCALCOMM;
+        snap.pascalbrace = false;
+        entries.push_back(snap);
+        snap.pascalbrace = true;
+        entries.push_back(snap);
+    }
+    /*
+    * with --minify, whitespace before a comment is held back until after it, and whether
+    * the comment followed code or not matters, too. indentation isn't held back if it's dropped.
+    */
+    if(m_opts.do_minify)
+    {
+        n = entries.size();
+        for(i=0; i<n; i++)
+        {
+            snap = entries[i];
+            snap.minline = false;
+            entries.push_back(snap);
+            snap.minspace = true;
+            entries.push_back(snap);
+            if(!m_opts.minify_dropindent)
+            {
+                snap.minline = true;
+                entries.push_back(snap);
+            }
+        }
+    }
+    ck.alternates.resize(entries.size());
+    for(i=0; i<entries.size(); i++)
+    {
+        runone(ck, ck.alternates[i], entries[i], false, speculationbudget);
+    }
+}
+
+bool ParallelStripper::run(SpanWriter& out)
+{
+    bool rc;
+    bool runrc;
+    size_t i;
+    size_t nthreads;
+    std::atomic<size_t> next;
+    std::vector<Chunk> chunks;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Run>> redone;
+    CommentStripper::Snapshot entry;
+    CommentStripper::Snapshot exit;
+    BlankLineFilter filter;
+    // for --strip, the stitched output is filtered; the chunks themselves aren't (see CommentStripper::runselect())
+    SpanWriter filtered([&](const char* data, size_t size)
+    {
+        return filter.feed(data, size, out);
+    });
+    SpanWriter& dest = (m_opts.remove_emptylines ? filtered : out);
+    splitchunks(chunks);
+    next = 0;
+    auto worker = [&]
+    {
+        size_t idx;
+        while((idx = next++) < chunks.size())
+        {
+            runchunk(chunks[idx]);
+        }
+    };
+    nthreads = std::min(m_nthreads, chunks.size());
+    for(i=1; i<nthreads; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& th: threads)
+    {
+        th.join();
+    }
+    /*
+    * stitch the runs together, in order.
+    * the state at the end of one chunk is the state at the beginning of the next,
+    * which determines which of that chunk's runs is the right one.
+    */
+    rc = true;
+    for(auto& ck: chunks)
+    {
+        Run* chosen;
+        chosen = nullptr;
+        if((ck.begin == 0) || (ck.primary.entry == entry))
+        {
+            chosen = &ck.primary;
+        }
+        else
+        {
+            for(auto& alt: ck.alternates)
+            {
+                if(alt.valid && (alt.entry == entry))
+                {
+                    chosen = &alt;
+                    break;
+                }
+            }
+            if(chosen == nullptr)
+            {
+                // nothing matched: redo it from the real state, until it converges
+                redone.emplace_back(new Run);
+                chosen = redone.back().get();
+                runone(ck, *chosen, entry, false, 0);
+            }
+        }
+        dest.span(chosen->output.data(), chosen->output.size());
+        (*m_diagfp) << chosen->diag;
+        exit = chosen->exit;
+        runrc = chosen->rc;
+        if(chosen->converged != -1)
+        {
+            /* from the checkpoint on, it's the same as the primary run */
+            const CommentStripper::Checkpoint& cp = ck.checkpoints[chosen->converged];
+            dest.span(ck.primary.output.data() + cp.outlen, ck.primary.output.size() - cp.outlen);
+            (*m_diagfp) << ck.primary.diag.substr(cp.diaglen);
+            exit = ck.primary.exit;
+            runrc = ck.primary.rc;
+        }
+        rc = (rc && runrc);
+        entry = exit;
+    }
+    if(m_opts.remove_emptylines)
+    {
+        rc = (filtered.flush() && rc);
+        filter.finish();
+    }
+    return (out.flush() && rc);
+}
@@ -0,0 +1,197 @@
+/*
+* PerfCounters - see perfcount.h
+*/
+
+#include <cerrno>
+#include <cstring>
+#if defined(__linux__)
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+#include "perfcount.h"
+
+#if defined(__linux__)
+
+// what each of PerfCounters::Counter is, to the kernel
+static void describe(PerfCounters::Counter c, struct perf_event_attr& attr)
+{
+    switch(c)
+    {
+        case PerfCounters::PC_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfCounters::PC_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfCounters::PC_BRANCHMISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = (
+                PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+            );
+            break;
+    }
+}
+
+static std::string openerror(PerfCounters::Counter c, int err)
+{
+    std::string res;
+    res = PerfCounters::name(c);
+    res += ": ";
+    switch(err)
+    {
+        case EACCES:
+        case EPERM:
+            res += "not permitted (see /proc/sys/kernel/perf_event_paranoid)";
+            break;
+        case ENOENT:
+        case EOPNOTSUPP:
+            res += "not supported by this CPU";
+            break;
+        case ENOSYS:
+            res += "perf_event_open() is not supported";
+            break;
+        default:
+            res += std::strerror(err);
+            break;
+    }
+    return res;
+}
+
+#endif
+
+PerfCounters::PerfCounters()
+{
+    size_t i;
+    for(i=0; i<PC_COUNT; i++)
+    {
+        m_fds[i] = -1;
+    }
+    #if defined(__linux__)
+    struct perf_event_attr attr;
+    for(i=0; i<PC_COUNT; i++)
+    {
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        describe(Counter(i), attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = (PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING);
+        // this thread, on any cpu
+        m_fds[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if((m_fds[i] == -1) && m_error.empty())
+        {
+            m_error = openerror(Counter(i), errno);
+        }
+    }
+    #else
+    m_error = "hardware counters are only supported on Linux";
+    #endif
+}
+
+PerfCounters::~PerfCounters()
+{
+    #if defined(__linux__)
+    size_t i;
+    for(i=0; i<PC_COUNT; i++)
+    {
+        if(m_fds[i] != -1)
+        {
+            close(m_fds[i]);
+        }
+    }
+    #endif
+}
+
+bool PerfCounters::available() const
+{
+    size_t i;
+    for(i=0; i<PC_COUNT; i++)
+    {
+        if(m_fds[i] != -1)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::start()
+{
+    #if defined(__linux__)
+    size_t i;
+    for(i=0; i<PC_COUNT; i++)
+    {
+        if(m_fds[i] != -1)
+        {
+            ioctl(m_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    #endif
+}
+
+PerfCounters::Sample PerfCounters::stop()
+{
+    Sample res;
+    #if defined(__linux__)
+    size_t i;
+    // value, time enabled, time running
+    uint64_t buf[3];
+    for(i=0; i<PC_COUNT; i++)
+    {
+        if(m_fds[i] != -1)
+        {
+            ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for(i=0; i<PC_COUNT; i++)
+    {
+        if(m_fds[i] == -1)
+        {
+            continue;
+        }
+        if((read(m_fds[i], buf, sizeof(buf)) != ssize_t(sizeof(buf))) || (buf[2] == 0))
+        {
+            // never got onto the pmu at all
+            continue;
+        }
+        res.values[i] = buf[0];
+        if(buf[2] < buf[1])
+        {
+            // only ran for part of the time, since there were more counters than the pmu has
+            res.values[i] = uint64_t(double(buf[0]) * (double(buf[1]) / double(buf[2])));
+        }
+        res.valid[i] = true;
+    }
+    #endif
+    return res;
+}
+
+const char* PerfCounters::name(Counter c)
+{
+    switch(c)
+    {
+        case PC_CYCLES:
+            return "cycles";
+        case PC_INSTRUCTIONS:
+            return "instructions";
+        case PC_BRANCHMISSES:
+            return "branch-misses";
+        case PC_L1DMISSES:
+            return "L1-dcache-misses";
+        default:
+            break;
+    }
+    return "???";
+}
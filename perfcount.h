@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/*
+* hardware performance counters around a piece of code, through perf_event_open(2).
+* used by rmcppbench --counters, to see where the cycles of CommentStripper::run() go.
+*
+* only the calling thread is counted, and only in userspace, which is what an
+* unprivileged process may do with kernel.perf_event_paranoid at 2 (the usual default).
+* each counter is opened on its own, so that one the CPU (or the hypervisor) doesn't
+* have doesn't take the others with it. if none can be opened - not Linux, a seccomp
+* filter, paranoid at 3 - available() is false, and error() says why.
+*/
+class PerfCounters
+{
+    public:
+        enum Counter
+        {
+            PC_CYCLES,
+            PC_INSTRUCTIONS,
+            PC_BRANCHMISSES,
+            // level 1 data cache read misses
+            PC_L1DMISSES,
+            PC_COUNT
+        };
+
+        struct Sample
+        {
+            uint64_t values[PC_COUNT] = {};
+            // false for counters that couldn't be opened
+            bool valid[PC_COUNT] = {};
+        };
+
+    private:
+        // -1 for counters that couldn't be opened
+        int m_fds[PC_COUNT];
+        std::string m_error;
+
+    public:
+        PerfCounters();
+        ~PerfCounters();
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        // @returns true if at least one counter could be opened
+        bool available() const;
+
+        // @returns why a counter couldn't be opened (the first one that failed), or an empty string
+        const std::string& error() const
+        {
+            return m_error;
+        }
+
+        // resets and starts every counter
+        void start();
+
+        /**
+        * stops every counter.
+        * @returns what they counted since start(), scaled up if the kernel had to multiplex them.
+        */
+        Sample stop();
+
+        // @returns the name of <c>, i.e., "cycles"
+        static const char* name(Counter c);
+};
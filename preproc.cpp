@@ -0,0 +1,892 @@
+/*
+* Preprocessor - see preproc.h
+*/
+
+#include "preproc.h"
+
+static inline bool isidentstart(unsigned char ch)
+{
+    return (((ch >= 'a') && (ch <= 'z')) || ((ch >= 'A') && (ch <= 'Z')) || (ch == '_'));
+}
+
+static inline bool isidentchar(unsigned char ch)
+{
+    return (isidentstart(ch) || ((ch >= '0') && (ch <= '9')));
+}
+
+static inline bool isdigit(unsigned char ch)
+{
+    return ((ch >= '0') && (ch <= '9'));
+}
+
+static inline bool isspacechar(unsigned char ch)
+{
+    return ((ch == ' ') || (ch == '\t') || (ch == '\n') || (ch == '\r') || (ch == '\f') || (ch == '\v'));
+}
+
+static bool isidentifier(const std::string& str)
+{
+    size_t i;
+    if(str.empty() || !isidentstart(str[0]))
+    {
+        return false;
+    }
+    for(i=1; i<str.size(); i++)
+    {
+        if(!isidentchar(str[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string_view trimmed(const char* begin, const char* end)
+{
+    while((begin < end) && isspacechar(*begin))
+    {
+        begin++;
+    }
+    while((end > begin) && isspacechar(end[-1]))
+    {
+        end--;
+    }
+    return std::string_view(begin, end - begin);
+}
+
+Preprocessor::Preprocessor(): m_lengths(0), m_linestart(true), m_memosize(0)
+{
+    m_frames.resize(maxdepth + 2);
+    m_firstbytes[0] = 0;
+    m_firstbytes[1] = 0;
+    m_firstbytes[2] = 0;
+    m_firstbytes[3] = 0;
+    m_slots.resize(64);
+}
+
+// FNV-1a. identifiers are short, so anything fancier wouldn't pay off
+uint64_t Preprocessor::hashname(const char* name, size_t len)
+{
+    size_t i;
+    uint64_t h;
+    h = 14695981039346656037ULL;
+    for(i=0; i<len; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void Preprocessor::rehash(size_t capacity)
+{
+    size_t i;
+    size_t mask;
+    std::vector<Slot> old;
+    old.swap(m_slots);
+    m_slots.assign(capacity, Slot());
+    mask = (capacity - 1);
+    for(const auto& slot: old)
+    {
+        if(slot.index == 0)
+        {
+            continue;
+        }
+        for(i=(slot.hash & mask); m_slots[i].index != 0; i=((i + 1) & mask))
+        {
+        }
+        m_slots[i] = slot;
+    }
+}
+
+long Preprocessor::lookup(const char* name, size_t len) const
+{
+    size_t i;
+    size_t mask;
+    uint64_t h;
+    h = hashname(name, len);
+    mask = (m_slots.size() - 1);
+    // linear probing: the first empty slot ends the search
+    for(i=(h & mask); m_slots[i].index != 0; i=((i + 1) & mask))
+    {
+        if(m_slots[i].hash == h)
+        {
+            const MacroDef& def = m_macros[m_slots[i].index - 1];
+            if((def.name.size() == len) && (std::memcmp(def.name.data(), name, len) == 0))
+            {
+                return long(m_slots[i].index - 1);
+            }
+        }
+    }
+    return -1;
+}
+
+void Preprocessor::add(MacroDef&& def)
+{
+    size_t i;
+    size_t mask;
+    long idx;
+    uint64_t h;
+    unsigned char first;
+    // what's memoized may depend on the old definition
+    m_memo.clear();
+    m_memosize = 0;
+    idx = lookup(def.name.data(), def.name.size());
+    if(idx != -1)
+    {
+        m_macros[idx] = std::move(def);
+        return;
+    }
+    if(((m_macros.size() + 1) * 2) > m_slots.size())
+    {
+        rehash(m_slots.size() * 2);
+    }
+    h = hashname(def.name.data(), def.name.size());
+    mask = (m_slots.size() - 1);
+    for(i=(h & mask); m_slots[i].index != 0; i=((i + 1) & mask))
+    {
+    }
+    first = (unsigned char)def.name[0];
+    m_firstbytes[first >> 6] |= (uint64_t(1) << (first & 63));
+    m_lengths |= (uint64_t(1) << std::min(def.name.size(), size_t(63)));
+    m_macros.push_back(std::move(def));
+    m_slots[i].hash = h;
+    m_slots[i].index = uint32_t(m_macros.size());
+}
+
+void Preprocessor::define(const std::string& name)
+{
+    add(MacroDef(name));
+}
+
+bool Preprocessor::defineflag(const std::string& str)
+{
+    size_t i;
+    size_t eq;
+    size_t close;
+    std::string body;
+    std::vector<std::string> params;
+    for(i=0; (i < str.size()) && isidentchar(str[i]); i++)
+    {
+    }
+    if((i == 0) || !isidentstart(str[0]))
+    {
+        return false;
+    }
+    if((i < str.size()) && (str[i] == '('))
+    {
+        close = str.find(')', i);
+        if(close == std::string::npos)
+        {
+            return false;
+        }
+        Util::split<char>(str.substr(i + 1, close - (i + 1)), ",", [&](const std::string& tok)
+        {
+            params.push_back(tok);
+        });
+        eq = (close + 1);
+        if(eq == str.size())
+        {
+            body = "1";
+        }
+        else if(str[eq] == '=')
+        {
+            body = str.substr(eq + 1);
+        }
+        else
+        {
+            return false;
+        }
+        return definefunc(str.substr(0, i), params, body);
+    }
+    if(i == str.size())
+    {
+        // as with the C preprocessor, -DNAME means NAME is 1
+        add(MacroDef(str, 1));
+    }
+    else if(str[i] == '=')
+    {
+        add(MacroDef(str.substr(0, i), str.substr(i + 1)));
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool Preprocessor::definefunc(const std::string& name, const std::vector<std::string>& params, const std::string& body)
+{
+    size_t i;
+    size_t j;
+    MacroDef def;
+    std::string_view trimbody;
+    if(!isidentifier(name))
+    {
+        return false;
+    }
+    def.name = name;
+    trimbody = trimmed(body.data(), body.data() + body.size());
+    def.value = std::string(trimbody);
+    def.hasvalue = !def.value.empty();
+    def.funclike = true;
+    for(i=0; i<params.size(); i++)
+    {
+        if((params[i] == "...") && ((i + 1) == params.size()))
+        {
+            def.variadic = true;
+            def.params.push_back("__VA_ARGS__");
+            continue;
+        }
+        if(!isidentifier(params[i]))
+        {
+            return false;
+        }
+        for(j=0; j<i; j++)
+        {
+            if(params[j] == params[i])
+            {
+                return false;
+            }
+        }
+        def.params.push_back(params[i]);
+    }
+    compile(def);
+    add(std::move(def));
+    return true;
+}
+
+void Preprocessor::compile(MacroDef& def)
+{
+    size_t i;
+    size_t p;
+    size_t start;
+    size_t size;
+    long param;
+    bool afterpaste;
+    bool stringify;
+    char quote;
+    const std::string& val = def.value;
+    // a range of <val> as text, merged with the previous piece if that's text right before it
+    auto addtext = [&](size_t off, size_t len)
+    {
+        BodyPiece pc;
+        if(!def.body.empty() && (def.body.back().kind == BodyPiece::BP_TEXT))
+        {
+            BodyPiece& last = def.body.back();
+            if((last.offset + last.length) == off)
+            {
+                last.length += len;
+                return;
+            }
+        }
+        pc.kind = BodyPiece::BP_TEXT;
+        pc.offset = off;
+        pc.length = len;
+        def.body.push_back(pc);
+    };
+    auto findparam = [&](size_t off, size_t len)
+    {
+        size_t k;
+        for(k=0; k<def.params.size(); k++)
+        {
+            if((def.params[k].size() == len) && (val.compare(off, len, def.params[k]) == 0))
+            {
+                return long(k);
+            }
+        }
+        return long(-1);
+    };
+    size = val.size();
+    afterpaste = false;
+    stringify = false;
+    p = 0;
+    while(p < size)
+    {
+        start = p;
+        if(isspacechar(val[p]))
+        {
+            while((p < size) && isspacechar(val[p]))
+            {
+                p++;
+            }
+            // whitespace around '##' and after '#' disappears
+            if(!afterpaste && !stringify && !((p + 1 < size) && (val[p] == '#') && (val[p + 1] == '#')))
+            {
+                addtext(start, p - start);
+            }
+            continue;
+        }
+        if((val[p] == '#') && ((p + 1) < size) && (val[p + 1] == '#'))
+        {
+            p += 2;
+            // the operand on the left is pasted as given, rather than expanded
+            if(!def.body.empty() && (def.body.back().kind == BodyPiece::BP_PARAM))
+            {
+                def.body.back().kind = BodyPiece::BP_RAWPARAM;
+            }
+            afterpaste = true;
+            stringify = false;
+            continue;
+        }
+        if(val[p] == '#')
+        {
+            p++;
+            stringify = true;
+            continue;
+        }
+        if(isidentstart(val[p]))
+        {
+            while((p < size) && isidentchar(val[p]))
+            {
+                p++;
+            }
+            param = findparam(start, p - start);
+            if(param != -1)
+            {
+                BodyPiece pc;
+                pc.param = size_t(param);
+                pc.kind = (stringify ? BodyPiece::BP_STRINGIFY : (afterpaste ? BodyPiece::BP_RAWPARAM : BodyPiece::BP_PARAM));
+                def.body.push_back(pc);
+                afterpaste = false;
+                stringify = false;
+                continue;
+            }
+        }
+        else if((val[p] == '"') || (val[p] == '\''))
+        {
+            quote = val[p];
+            p++;
+            while((p < size) && (val[p] != quote))
+            {
+                if((val[p] == '\\') && ((p + 1) < size))
+                {
+                    p++;
+                }
+                p++;
+            }
+            if(p < size)
+            {
+                p++;
+            }
+        }
+        else
+        {
+            p++;
+        }
+        // a '#' not followed by a parameter is just a '#'
+        if(stringify)
+        {
+            for(i=start; (i > 0) && (val[i - 1] != '#'); i--)
+            {
+            }
+            addtext(i - 1, start - (i - 1));
+            stringify = false;
+        }
+        afterpaste = false;
+        addtext(start, p - start);
+    }
+    if(stringify)
+    {
+        addtext(size - 1, 1);
+    }
+}
+
+void Preprocessor::stringify(std::string_view arg, std::string& dest)
+{
+    bool escaped;
+    bool pendingspace;
+    char quote;
+    escaped = false;
+    pendingspace = false;
+    quote = 0;
+    dest.push_back('"');
+    for(char ch: arg)
+    {
+        // runs of whitespace become a single space (the argument is already trimmed)
+        if((quote == 0) && isspacechar(ch))
+        {
+            pendingspace = true;
+            continue;
+        }
+        if(pendingspace)
+        {
+            dest.push_back(' ');
+            pendingspace = false;
+        }
+        // quotes and backslashes in literals are escaped, so that the result reads back the same
+        if(quote != 0)
+        {
+            if(escaped)
+            {
+                escaped = false;
+            }
+            else if(ch == '\\')
+            {
+                escaped = true;
+            }
+            else if(ch == quote)
+            {
+                quote = 0;
+            }
+            if((ch == '"') || (ch == '\\'))
+            {
+                dest.push_back('\\');
+            }
+        }
+        else if((ch == '"') || (ch == '\''))
+        {
+            quote = ch;
+            if(ch == '"')
+            {
+                dest.push_back('\\');
+            }
+        }
+        dest.push_back(ch);
+    }
+    dest.push_back('"');
+}
+
+bool Preprocessor::definefile(const std::string& path)
+{
+    size_t lineno;
+    std::string line;
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if(!ifs.good())
+    {
+        Util::error(RMCPP_FMT("cannot open %q for reading"), path);
+        return false;
+    }
+    lineno = 0;
+    while(std::getline(ifs, line))
+    {
+        lineno++;
+        if(!line.empty() && (line.back() == '\r'))
+        {
+            line.pop_back();
+        }
+        if(line.empty())
+        {
+            continue;
+        }
+        if(!defineflag(line))
+        {
+            Util::error(RMCPP_FMT("%s:%d: not a valid definition: %q"), path, lineno, line);
+            return false;
+        }
+    }
+    return true;
+}
+
+const Preprocessor::MacroDef* Preprocessor::find(const std::string& name) const
+{
+    long idx;
+    if(name.empty())
+    {
+        return nullptr;
+    }
+    idx = lookup(name.data(), name.size());
+    if(idx == -1)
+    {
+        return nullptr;
+    }
+    return &m_macros[idx];
+}
+
+template<typename OutT>
+const char* Preprocessor::expand(const char* begin, const char* end, OutT& out, size_t depth, bool final)
+{
+    long idx;
+    bool linestart;
+    char quote;
+    const char* p;
+    const char* q;
+    const char* start;
+    const char* close;
+    p = begin;
+    // replacement text never starts a line, as far as directives are concerned
+    linestart = ((depth == 0) && m_linestart);
+    while(p < end)
+    {
+        start = p;
+        if(isidentstart(*p))
+        {
+            p++;
+            while((p < end) && isidentchar(*p))
+            {
+                p++;
+            }
+            if((p == end) && !final)
+            {
+                // might go on in the next piece
+                p = start;
+                break;
+            }
+            linestart = false;
+            if(mightbemacro(start, p - start))
+            {
+                idx = lookup(start, p - start);
+                if((idx != -1) && !m_macros[idx].active && (depth < maxdepth))
+                {
+                    MacroDef& def = m_macros[idx];
+                    if(def.funclike)
+                    {
+                        // only an invocation if a '(' follows, possibly on another line
+                        q = p;
+                        while((q < end) && isspacechar(*q))
+                        {
+                            q++;
+                        }
+                        if((q == end) && !final)
+                        {
+                            p = start;
+                            break;
+                        }
+                        if((q == end) || (*q != '('))
+                        {
+                            out.span(start, p - start);
+                            continue;
+                        }
+                        close = collectargs(def, q + 1, end, m_frames[depth]);
+                        if(close == nullptr)
+                        {
+                            if(!final)
+                            {
+                                p = start;
+                                break;
+                            }
+                            // never closed: not an invocation after all
+                            out.span(start, p - start);
+                            continue;
+                        }
+                        if(!invoke(def, idx, out, depth))
+                        {
+                            out.span(start, close - start);
+                        }
+                        p = close;
+                        continue;
+                    }
+                    def.active = true;
+                    expand(def.value.data(), def.value.data() + def.value.size(), out, depth + 1, true);
+                    def.active = false;
+                    continue;
+                }
+            }
+            out.span(start, p - start);
+        }
+        else if(isdigit(*p) || ((*p == '.') && ((p + 1) < end) && isdigit(p[1])))
+        {
+            /*
+            * a preprocessing number: digits, letters, dots, and signs after an exponent.
+            * covers 0x1F, 1e+10, 10ULL, and so on - none of which contain identifiers.
+            */
+            p++;
+            while(p < end)
+            {
+                if(((*p == '+') || (*p == '-')) && ((p[-1] == 'e') || (p[-1] == 'E') || (p[-1] == 'p') || (p[-1] == 'P')))
+                {
+                    p++;
+                }
+                else if(isidentchar(*p) || (*p == '.'))
+                {
+                    p++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            if((p == end) && !final)
+            {
+                p = start;
+                break;
+            }
+            linestart = false;
+            out.span(start, p - start);
+        }
+        else if((*p == '.') && ((p + 1) == end) && !final)
+        {
+            // can't tell yet whether it starts a number
+            break;
+        }
+        else if((*p == '"') || (*p == '\''))
+        {
+            // up to the closing quote, or the end of the line, if there isn't one
+            quote = *p;
+            p++;
+            while((p < end) && (*p != quote) && (*p != '\n'))
+            {
+                if((*p == '\\') && ((p + 1) < end))
+                {
+                    p++;
+                }
+                p++;
+            }
+            if((p == end) && !final)
+            {
+                p = start;
+                break;
+            }
+            if((p < end) && (*p == quote))
+            {
+                p++;
+            }
+            linestart = false;
+            out.span(start, p - start);
+        }
+        else if((*p == '#') && linestart)
+        {
+            // a directive: copied up to the end of the line, including continued lines
+            while((p < end) && (*p != '\n'))
+            {
+                if((*p == '\\') && ((p + 1) < end) && (p[1] == '\n'))
+                {
+                    p++;
+                }
+                p++;
+            }
+            if((p == end) && !final)
+            {
+                p = start;
+                break;
+            }
+            out.span(start, p - start);
+        }
+        else
+        {
+            // anything else can be copied up to the next byte that might start one of the above
+            while(p < end)
+            {
+                if(*p == '\n')
+                {
+                    linestart = (depth == 0);
+                }
+                else if((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\f') || (*p == '\v'))
+                {
+                }
+                else if(isidentchar(*p) || (*p == '"') || (*p == '\'') || (*p == '.') || (*p == '#'))
+                {
+                    break;
+                }
+                else
+                {
+                    linestart = false;
+                }
+                p++;
+            }
+            if(p == start)
+            {
+                // a '.' that doesn't start a number, or a '#' that doesn't start a directive
+                p++;
+                linestart = false;
+            }
+            out.span(start, p - start);
+        }
+    }
+    if(depth == 0)
+    {
+        m_linestart = linestart;
+    }
+    return p;
+}
+
+const char* Preprocessor::collectargs(const MacroDef& def, const char* begin, const char* end, Frame& frame)
+{
+    size_t nesting;
+    char quote;
+    const char* p;
+    const char* argstart;
+    frame.args.clear();
+    nesting = 0;
+    argstart = begin;
+    p = begin;
+    while(p < end)
+    {
+        if((*p == '"') || (*p == '\''))
+        {
+            quote = *p;
+            p++;
+            while((p < end) && (*p != quote) && (*p != '\n'))
+            {
+                if((*p == '\\') && ((p + 1) < end))
+                {
+                    p++;
+                }
+                p++;
+            }
+            if(p == end)
+            {
+                return nullptr;
+            }
+        }
+        else if(*p == '(')
+        {
+            nesting++;
+        }
+        else if(*p == ')')
+        {
+            if(nesting == 0)
+            {
+                frame.args.push_back(trimmed(argstart, p));
+                return (p + 1);
+            }
+            nesting--;
+        }
+        else if((*p == ',') && (nesting == 0))
+        {
+            // commas in __VA_ARGS__ don't separate arguments
+            if(!def.variadic || ((frame.args.size() + 1) < def.params.size()))
+            {
+                frame.args.push_back(trimmed(argstart, p));
+                argstart = (p + 1);
+            }
+        }
+        p++;
+    }
+    return nullptr;
+}
+
+template<typename OutT>
+bool Preprocessor::invoke(MacroDef& def, long idx, OutT& out, size_t depth)
+{
+    size_t i;
+    size_t nparams;
+    bool memoize;
+    Frame& frame = m_frames[depth];
+    nparams = def.params.size();
+    if((nparams == 0) && (frame.args.size() == 1) && frame.args[0].empty())
+    {
+        // f()
+        frame.args.clear();
+    }
+    else if(def.variadic && ((frame.args.size() + 1) == nparams))
+    {
+        // f(a, ...) invoked as f(a)
+        frame.args.emplace_back();
+    }
+    if(frame.args.size() != nparams)
+    {
+        return false;
+    }
+    memoize = (depth == 0);
+    if(memoize)
+    {
+        m_memokey.assign((const char*)&idx, sizeof(idx));
+        for(i=0; i<nparams; i++)
+        {
+            m_memokey.append(frame.args[i].data(), frame.args[i].size());
+            m_memokey.push_back('\0');
+        }
+        auto it = m_memo.find(m_memokey);
+        if(it != m_memo.end())
+        {
+            out.write(it->second.data(), it->second.size());
+            return true;
+        }
+    }
+    if(frame.expanded.size() < nparams)
+    {
+        frame.expanded.resize(nparams);
+    }
+    frame.isexpanded.assign(nparams, false);
+    frame.result.clear();
+    // arguments are expanded when first needed, before the macro itself is made inactive
+    for(const BodyPiece& pc: def.body)
+    {
+        switch(pc.kind)
+        {
+            case BodyPiece::BP_TEXT:
+                frame.result.append(def.value, pc.offset, pc.length);
+                break;
+            case BodyPiece::BP_RAWPARAM:
+                frame.result.append(frame.args[pc.param]);
+                break;
+            case BodyPiece::BP_STRINGIFY:
+                stringify(frame.args[pc.param], frame.result);
+                break;
+            case BodyPiece::BP_PARAM:
+                if(!frame.isexpanded[pc.param])
+                {
+                    std::string_view arg = frame.args[pc.param];
+                    StringOut argout{frame.expanded[pc.param]};
+                    frame.expanded[pc.param].clear();
+                    expand(arg.data(), arg.data() + arg.size(), argout, depth + 1, true);
+                    frame.isexpanded[pc.param] = true;
+                }
+                frame.result.append(frame.expanded[pc.param]);
+                break;
+        }
+    }
+    def.active = true;
+    if(memoize)
+    {
+        std::string value;
+        StringOut valout{value};
+        expand(frame.result.data(), frame.result.data() + frame.result.size(), valout, depth + 1, true);
+        out.write(value.data(), value.size());
+        if((m_memosize + m_memokey.size() + value.size()) > maxmemosize)
+        {
+            m_memo.clear();
+            m_memosize = 0;
+        }
+        m_memosize += (m_memokey.size() + value.size());
+        m_memo.emplace(m_memokey, std::move(value));
+    }
+    else
+    {
+        // frame.result is reused by the next invocation at this depth, so it can't be handed out as spans
+        auto&& dest = copying(out);
+        expand(frame.result.data(), frame.result.data() + frame.result.size(), dest, depth + 1, true);
+    }
+    def.active = false;
+    return true;
+}
+
+bool Preprocessor::feed(const char* data, size_t size, SpanWriter& out)
+{
+    size_t take;
+    const char* nl;
+    const char* rest;
+    /*
+    * whatever was left over from the last piece is completed first: a line
+    * (or rather, the rest of it) at a time, which is enough to end any token
+    * but a continued directive.
+    */
+    while((size > 0) && !m_carry.empty())
+    {
+        nl = (const char*)std::memchr(data, '\n', size);
+        take = ((nl == nullptr) ? size : size_t((nl + 1) - data));
+        m_carry.append(data, take);
+        data += take;
+        size -= take;
+        // an invocation may span lines, but not without end
+        rest = expand(m_carry.data(), m_carry.data() + m_carry.size(), out, 0, (m_carry.size() > maxcarry));
+        // spans may point into m_carry
+        out.flush();
+        m_carry.erase(0, rest - m_carry.data());
+    }
+    if(size > 0)
+    {
+        rest = expand(data, data + size, out, 0, false);
+        // ... or into <data>, which is gone after this
+        out.flush();
+        m_carry.assign(rest, (data + size) - rest);
+    }
+    return out.good();
+}
+
+bool Preprocessor::finish(SpanWriter& out)
+{
+    expand(m_carry.data(), m_carry.data() + m_carry.size(), out, 0, true);
+    out.flush();
+    m_carry.clear();
+    m_linestart = true;
+    return out.good();
+}
+
+bool Preprocessor::run(const char* data, size_t size, SpanWriter& out)
+{
+    expand(data, data + size, out, 0, true);
+    m_linestart = true;
+    return out.good();
+}
@@ -0,0 +1,317 @@
+#pragma once
+#include <cstdint>
+#include <sstream>
+#include <unordered_map>
+#include "rmcpp.h"
+
+/*
+* substitutes macros (-DNAME=value, -D'NAME(a,b)=value') in already stripped source.
+*
+* works on identifiers, the way the C preprocessor does: string and char literals,
+* and numbers like 0x1F or 1e10, are left alone, as are preprocessor directives
+* (lines starting with '#'), since rmcpp doesn't evaluate them, and substituting
+* inside of '#define' or '#ifdef' lines would only break them.
+* replacement text is rescanned for more macros; a macro is never expanded within
+* its own expansion.
+*
+* function-like macros work as they do in C: arguments are macro-expanded before they
+* are substituted, unless they are stringified ('#x') or pasted ('a ## b'), and
+* '...' collects the remaining arguments as __VA_ARGS__. unlike C, a function-like macro
+* named at the very end of a replacement doesn't pick up arguments following the
+* invocation it came from.
+*
+* lookups are meant to stay cheap with tens of thousands of definitions: an identifier
+* is only hashed if its first byte and its length can belong to a macro at all, and
+* is then looked up in an open-addressing hash table.
+*/
+class Preprocessor
+{
+    public:
+        /*
+        * a piece of the body of a function-like macro, split up once when it is defined.
+        * anything that isn't a parameter is copied as-is.
+        */
+        struct BodyPiece
+        {
+            enum Kind
+            {
+                BP_TEXT,
+                // a parameter, macro-expanded first
+                BP_PARAM,
+                // a parameter next to '##', as it was given
+                BP_RAWPARAM,
+                // '#param'
+                BP_STRINGIFY,
+            };
+
+            Kind kind = BP_TEXT;
+            // if BP_TEXT, a range of MacroDef::value
+            size_t offset = 0;
+            size_t length = 0;
+            // otherwise, the index of the parameter
+            size_t param = 0;
+        };
+
+        struct MacroDef
+        {
+            std::string name;
+            std::string value;
+            bool hasvalue = false;
+
+            // NAME(...), rather than just NAME
+            bool funclike = false;
+            // the last parameter is '...', called __VA_ARGS__ in the body
+            bool variadic = false;
+            std::vector<std::string> params;
+            std::vector<BodyPiece> body;
+
+            // true while the macro is being expanded, to stop it from expanding itself
+            bool active = false;
+
+            MacroDef()
+            {
+            }
+
+            MacroDef(const std::string& nm): name(nm), value(), hasvalue(false)
+            {
+            }
+
+            template<typename... ArgsT>
+            MacroDef(const std::string& nm, ArgsT&&... args): name(nm)
+            {
+                std::stringstream valstrm;
+                ((valstrm << args), ...);
+                value = valstrm.str();
+                if(!value.empty())
+                {
+                    hasvalue = true;
+                }
+            }
+        };
+
+        // expansions nested deeper than this are left as they are
+        static constexpr size_t maxdepth = 256;
+
+        // invocations whose arguments run on longer than this are given up on, and left as they are
+        static constexpr size_t maxcarry = (1024 * 1024);
+
+        // memoized expansions are dropped once they take up more than this
+        static constexpr size_t maxmemosize = (16 * 1024 * 1024);
+
+    private:
+        /*
+        * one slot of the hash table. <index> is an index into m_macros, plus one;
+        * 0 marks an empty slot.
+        */
+        struct Slot
+        {
+            uint64_t hash = 0;
+            uint32_t index = 0;
+        };
+
+        /*
+        * the scratch space used to expand an invocation: its arguments, their expansions,
+        * and the substituted body. there is one per nesting depth, all allocated up front,
+        * and reused for every invocation at that depth; buffers are cleared, but never
+        * shrunk, so once they have grown to fit, expanding a macro allocates nothing.
+        */
+        struct Frame
+        {
+            std::vector<std::string_view> args;
+            std::vector<std::string> expanded;
+            std::vector<bool> isexpanded;
+            std::string result;
+        };
+
+        // makes expand() append to a string, rather than write to a SpanWriter
+        struct StringOut
+        {
+            std::string& str;
+
+            void span(const char* data, size_t size)
+            {
+                str.append(data, size);
+            }
+
+            void write(const char* data, size_t size)
+            {
+                str.append(data, size);
+            }
+        };
+
+        // makes expand() copy everything it writes, for text that doesn't outlive the call (like Frame::result)
+        struct CopyOut
+        {
+            SpanWriter& out;
+
+            void span(const char* data, size_t size)
+            {
+                out.write(data, size);
+            }
+
+            void write(const char* data, size_t size)
+            {
+                out.write(data, size);
+            }
+        };
+
+    private:
+        std::vector<MacroDef> m_macros;
+        // capacity is always a power of two, and kept at least twice the number of macros
+        std::vector<Slot> m_slots;
+        // bit <n> is set if some macro starts with byte <n>
+        uint64_t m_firstbytes[4];
+        // bit <n> is set if some macro is <n> bytes long; bit 63 stands for 63 and longer
+        uint64_t m_lengths;
+
+        // the start of a token cut off at the end of the last piece fed in (see feed())
+        std::string m_carry;
+        // true if the next byte fed in starts a line
+        bool m_linestart;
+
+        // maxdepth + 1 of them; never resized, so references stay valid
+        std::vector<Frame> m_frames;
+
+        /*
+        * complete expansions of top level invocations, keyed by the macro and its arguments.
+        * at the top level, no macro is being expanded, so the same arguments always
+        * expand to the same text.
+        */
+        std::unordered_map<std::string, std::string> m_memo;
+        size_t m_memosize;
+        std::string m_memokey;
+
+    private:
+        static uint64_t hashname(const char* name, size_t len);
+        static void compile(MacroDef& def);
+        static void stringify(std::string_view arg, std::string& dest);
+
+        static CopyOut copying(SpanWriter& out)
+        {
+            return CopyOut{out};
+        }
+
+        static CopyOut& copying(CopyOut& out)
+        {
+            return out;
+        }
+
+        static StringOut& copying(StringOut& out)
+        {
+            return out;
+        }
+
+        void rehash(size_t capacity);
+        void add(MacroDef&& def);
+
+        bool mightbemacro(const char* name, size_t len) const
+        {
+            unsigned char first;
+            first = (unsigned char)name[0];
+            return (
+                ((m_firstbytes[first >> 6] >> (first & 63)) & 1) &&
+                ((m_lengths >> std::min(len, size_t(63))) & 1)
+            );
+        }
+
+        // @returns the index of <name> in m_macros, or -1
+        long lookup(const char* name, size_t len) const;
+
+        /*
+        * writes [begin, end) to <out> (a SpanWriter, CopyOut, or StringOut), with macros expanded.
+        * unless <final> is set, a token that runs into <end> is left alone, since the
+        * next piece may continue it - as is an invocation whose arguments do.
+        * @returns the end of what was written, i.e. the start of such a token, or <end>.
+        */
+        template<typename OutT>
+        const char* expand(const char* begin, const char* end, OutT& out, size_t depth, bool final);
+
+        /*
+        * reads the arguments of an invocation of <def>, starting just past the '('
+        * at <begin>, into <frame>.
+        * @returns a pointer just past the closing ')', or null if <end> came first.
+        */
+        const char* collectargs(const MacroDef& def, const char* begin, const char* end, Frame& frame);
+
+        // expands <def> with the arguments in m_frames[<depth>]
+        // @returns false if the number of arguments is wrong, having written nothing
+        template<typename OutT>
+        bool invoke(MacroDef& def, long idx, OutT& out, size_t depth);
+
+    public:
+        Preprocessor();
+
+        /*
+        * defines <name> as empty, replacing any earlier definition.
+        * note that this differs from -DNAME, which defines NAME as 1 (as the C preprocessor does).
+        */
+        void define(const std::string& name);
+
+        /*
+        * defines <name> as <args>, stringified and concatenated, i.e.
+        *
+        *   pp.define("VERSION", 1, ".", 2);
+        *
+        * defines VERSION as 1.2.
+        */
+        template<typename... ArgsT>
+        void define(const std::string& name, ArgsT&&... args)
+        {
+            add(MacroDef(name, args...));
+        }
+
+        /*
+        * defines the function-like macro <name>, i.e.
+        *
+        *   pp.definefunc("assert", {"x"}, "if(!(x)){ fprintf(stderr, \"ASSERTION %s\\n\", #x); abort(); }");
+        *
+        * a last parameter of "..." makes it variadic.
+        * @returns false if a parameter is not a valid identifier, or given twice.
+        */
+        bool definefunc(const std::string& name, const std::vector<std::string>& params, const std::string& body);
+
+        /**
+        * defines a macro as given on the command line: "NAME" (defined as 1), "NAME=value",
+        * or "NAME(a, b)=value".
+        * @returns false if <str> doesn't start with a valid identifier, or has a malformed parameter list.
+        */
+        bool defineflag(const std::string& str);
+
+        /**
+        * reads definitions from <path>, one per line, as in defineflag().
+        * empty lines are skipped.
+        * @returns false (and complains) if the file can't be read, or a line is invalid.
+        */
+        bool definefile(const std::string& path);
+
+        // @returns the definition of <name>, or null
+        const MacroDef* find(const std::string& name) const;
+
+        size_t count() const
+        {
+            return m_macros.size();
+        }
+
+        /**
+        * like run(), but for input that comes in pieces: the output of CommentStripper,
+        * for instance, through a SpanWriter(ChunkFunc). tokens cut off at the end of a piece
+        * are held back until the next; call finish() after the last one.
+        * <out> is flushed before returning, so <data> only needs to stay valid for the call.
+        * @returns false if <out> could not be written to.
+        */
+        bool feed(const char* data, size_t size, SpanWriter& out);
+
+        /**
+        * writes whatever feed() held back, and gets ready for the next input.
+        * @returns false if <out> could not be written to.
+        */
+        bool finish(SpanWriter& out);
+
+        /**
+        * writes [data, data+size) to <out>, with macros substituted.
+        * parts of the input are handed to <out> as spans, so <data> must stay
+        * valid until <out> is flushed.
+        * @returns false if <out> could not be written to.
+        */
+        bool run(const char* data, size_t size, SpanWriter& out);
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#if !defined(_WIN32)
+    #include <cerrno>
+    #include <climits>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    // not everyone has it. those that don't need to ignore SIGPIPE instead
+    #if !defined(MSG_NOSIGNAL)
+        #define MSG_NOSIGNAL 0
+    #endif
+#endif
+
+/*
+* the wire format spoken between `rmcpp --serve` (see server.h) and its client (client.cpp).
+*
+* kept free of iostreams and the rest of rmcpp.h, so that the client stays small,
+* and starts up fast - which is the whole point of having a server.
+*
+* a client connects to the server's unix domain socket, and sends any number of
+* requests, one after the other; every request is answered before the next one is read.
+* all integers are little-endian.
+*
+* request:
+*
+*   offset  size  what
+*        0     4  magic, "RMQ1"
+*        4     4  flags (ReqFlags)
+*        8     4  kind: RK_PATH (the payload is the path of the input file, which the
+*                 server reads itself) or RK_INLINE (the payload is the input itself)
+*       12     4  size of the display name (0 for none)
+*       16     8  size of the payload
+*       24     -  the payload, followed by the display name
+*
+* the display name is what messages call the input, i.e., the path as the user typed it,
+* rather than whatever the client resolved it to. without one, messages use the path
+* (RK_PATH), or "<stdin>" (RK_INLINE).
+*
+* response:
+*
+*   offset  size  what
+*        0     4  magic, "RMA1"
+*        4     4  status (RespStatus)
+*        8     8  size of the stripped output
+*       16     8  size of the removed comments (only sent with RF_COMMENTS)
+*       24     8  size of messages (warnings, debug output, errors), as rmcpp would have written them to stderr
+*       32     -  output, comments, and messages, in that order
+*/
+namespace Protocol
+{
+    static constexpr uint32_t requestmagic = 0x31514D52;  // "RMQ1"
+    static constexpr uint32_t responsemagic = 0x31414D52; // "RMA1"
+
+    static constexpr size_t requestheadersize = 24;
+    static constexpr size_t responseheadersize = 32;
+
+    // the same as the command line options of the same name
+    enum ReqFlags
+    {
+        RF_NOWARNINGS = (1 << 0),
+        RF_DEBUG = (1 << 1),
+        RF_STRIP = (1 << 2),
+        RF_KEEPANSI = (1 << 3),
+        RF_KEEPCPP = (1 << 4),
+        RF_PASCAL = (1 << 5),
+        RF_HASH = (1 << 6),
+        RF_CONVERTCPP = (1 << 7),
+        // send back the removed comments, like --writecomments
+        RF_COMMENTS = (1 << 8),
+        RF_MINIFY = (1 << 9),
+        RF_MINIFYINDENT = (1 << 10),
+    };
+
+    enum ReqKind
+    {
+        RK_PATH = 0,
+        RK_INLINE = 1,
+    };
+
+    enum RespStatus
+    {
+        // stripped, without complaints
+        RS_OK = 0,
+        // stripped, but rmcpp would have exited with a failure (i.e., an unterminated comment)
+        RS_FAILED = 1,
+        // nothing was stripped; the messages say why
+        RS_ERROR = 2,
+    };
+
+    /*
+    * requests larger than these are refused (the server hangs up), rather than having it
+    * allocate whatever a client claims.
+    */
+    static constexpr uint64_t maxinline = (uint64_t(256) * 1024 * 1024);
+    #if !defined(_WIN32)
+    // for paths (RK_PATH) and display names
+    static constexpr uint64_t maxpath = PATH_MAX;
+    #endif
+
+    inline void putle(unsigned char* dest, uint64_t value, size_t nbytes)
+    {
+        size_t i;
+        for(i=0; i<nbytes; i++)
+        {
+            dest[i] = (unsigned char)((value >> (i * 8)) & 0xFF);
+        }
+    }
+
+    inline uint64_t getle(const unsigned char* src, size_t nbytes)
+    {
+        size_t i;
+        uint64_t value;
+        value = 0;
+        for(i=0; i<nbytes; i++)
+        {
+            value |= (uint64_t(src[i]) << (i * 8));
+        }
+        return value;
+    }
+
+    #if !defined(_WIN32)
+    /*
+    * reads exactly <size> bytes from <fd>, retrying on short reads and EINTR.
+    * @returns false on errors, or if the other end went away.
+    */
+    inline bool readall(int fd, void* dest, size_t size)
+    {
+        ssize_t rc;
+        char* p;
+        p = (char*)dest;
+        while(size > 0)
+        {
+            rc = ::read(fd, p, size);
+            if(rc == -1)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            if(rc == 0)
+            {
+                return false;
+            }
+            p += rc;
+            size -= rc;
+        }
+        return true;
+    }
+
+    /*
+    * same as readall(), the other way around. <fd> has to be a socket: a client
+    * going away should fail the write, rather than kill the server with SIGPIPE.
+    */
+    inline bool writeall(int fd, const void* src, size_t size)
+    {
+        ssize_t rc;
+        const char* p;
+        p = (const char*)src;
+        while(size > 0)
+        {
+            rc = ::send(fd, p, size, MSG_NOSIGNAL);
+            if(rc == -1)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += rc;
+            size -= rc;
+        }
+        return true;
+    }
+    #endif
+}
@@ -8,6 +8,12 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <charconv>
+#include <type_traits>
 
 namespace Util
 {
@@ -73,47 +79,51 @@ namespace Util
         }
     }
 
-    template<typename CharT>
-    void escapechar(std::basic_ostream<CharT>& out, int ch, bool wquotes=false)
+    /*
+    * writes <ch> to <dest> (at least 4 bytes), escaped as in a C string literal if it
+    * isn't printable; a quote is escaped, too, if <wquotes> is set.
+    * @returns the number of bytes written.
+    */
+    inline size_t escapeto(char* dest, unsigned char ch, bool wquotes=false)
     {
+        static const char hexdigits[] = "0123456789ABCDEF";
+        if((ch == '\\') || ((ch == '"') && wquotes))
+        {
+            dest[0] = '\\';
+            dest[1] = char(ch);
+            return 2;
+        }
         if((ch >= 32) && (ch <= 126))
         {
-            if(ch == '\\')
-            {
-                out << CharT('\\') << CharT('\\');
-            }
-            else
-            {
-                out << CharT(ch);
-            }
-            return;
+            dest[0] = char(ch);
+            return 1;
         }
-        else
+        dest[0] = '\\';
+        switch(ch)
         {
-            if((ch == CharT('"')) && wquotes)
-            {
-                out << CharT('\\') << CharT('"');
-                return;
-            }
-            switch(ch)
-            {
-                case 0:    out << CharT('\\') << CharT('0'); return;
-                case 1:    out << CharT('\\') << CharT('1'); return;
-                case '\n': out << CharT('\\') << CharT('n'); return;
-                case '\r': out << CharT('\\') << CharT('r'); return;
-                case '\t': out << CharT('\\') << CharT('t'); return;
-                case '\f': out << CharT('\\') << CharT('f'); return;
-            }
-            out
-                << CharT('\\')
-                << CharT('x')
-                << std::setfill('0')
-                << std::setw(2)
-                << std::uppercase
-                << std::hex
-                << CharT(ch)
-                << std::resetiosflags(std::ios_base::basefield)
-            ;
+            case 0:    dest[1] = '0'; return 2;
+            case 1:    dest[1] = '1'; return 2;
+            case '\n': dest[1] = 'n'; return 2;
+            case '\r': dest[1] = 'r'; return 2;
+            case '\t': dest[1] = 't'; return 2;
+            case '\f': dest[1] = 'f'; return 2;
+        }
+        dest[1] = 'x';
+        dest[2] = hexdigits[ch >> 4];
+        dest[3] = hexdigits[ch & 15];
+        return 4;
+    }
+
+    template<typename CharT>
+    void escapechar(std::basic_ostream<CharT>& out, int ch, bool wquotes=false)
+    {
+        size_t i;
+        size_t len;
+        char buf[4];
+        len = escapeto(buf, (unsigned char)ch, wquotes);
+        for(i=0; i<len; i++)
+        {
+            out << CharT(buf[i]);
         }
     }
 
@@ -134,81 +144,613 @@ namespace Util
         }
     }
 
-    template<typename CharT>
-    std::basic_ostream<CharT>&
-    sfprintf(
-        std::basic_ostream<CharT>& out,
-        const std::string& format)
-    {
-        out << format;
-        return out;
-    }
-     
-    template<typename CharT, typename Type, typename... Targs>
-    std::basic_ostream<CharT>& sfprintf(
-        std::basic_ostream<CharT>& out,
-        const std::string& fmt,
-        Type value,
-        Targs... Fargs
-    )
+    /*
+    * the formatter behind sfprintf(): the format string is taken apart at compile time,
+    * and the output is put together in a buffer on the stack, without allocating.
+    */
+    namespace Format
     {
-        int cd;
-        size_t i;
-        for (i=0; i<fmt.size(); i++)
+        // the literal text [litbegin, litend) of a format string, followed by the flag <flag> (0 at the end)
+        struct Piece
         {
-            if(fmt[i] == '%')
+            size_t litbegin = 0;
+            size_t litend = 0;
+            char flag = 0;
+        };
+
+        template<size_t CountV>
+        struct Plan
+        {
+            Piece pieces[CountV];
+        };
+
+        constexpr bool isflag(char ch)
+        {
+            return (
+                (ch == '%') || (ch == 's') || (ch == 'd') || (ch == 'l') ||
+                (ch == 'c') || (ch == 'p') || (ch == 'q')
+            );
+        }
+
+        // @returns the number of flags in <fmt>, '%%' included, or -1 if one of them is invalid
+        constexpr long countflags(std::string_view fmt)
+        {
+            // constexpr functions can't have uninitialized locals (until C++20)
+            size_t i = 0;
+            long count = 0;
+            for(i=0; i<fmt.size(); i++)
             {
-                cd = fmt[i + 1];
-                switch(cd)
+                if(fmt[i] == '%')
                 {
-                    case '%':
-                        out << CharT('%');
-                        break;
-                    case 's':
-                    case 'd':
-                    case 'l':
-                    case 'c':
-                        out << value;
-                        break;
-                    case 'p':
-                        {
-                            std::basic_stringstream<CharT> tmp;
-                            tmp << value;
-                            escapestring(out, tmp.str(), false);
-                        }
-                        break;
-                    case 'q':
-                        {
-                            std::basic_stringstream<CharT> tmp;
-                            tmp << value;
-                            escapestring(out, tmp.str(), true);
-                        }
-                        break;
-                    default:
+                    if(((i + 1) == fmt.size()) || !isflag(fmt[i + 1]))
+                    {
+                        return -1;
+                    }
+                    count++;
+                    i++;
+                }
+            }
+            return count;
+        }
+
+        // @returns the number of arguments <fmt> takes, i.e., its flags, except '%%'
+        constexpr long countargs(std::string_view fmt)
+        {
+            size_t i = 0;
+            long count = 0;
+            for(i=0; (i + 1)<fmt.size(); i++)
+            {
+                if(fmt[i] == '%')
+                {
+                    if(fmt[i + 1] != '%')
+                    {
+                        count++;
+                    }
+                    i++;
+                }
+            }
+            return count;
+        }
+
+        // <CountV> must be countflags(fmt) + 1: one piece per flag, plus the text after the last
+        template<size_t CountV>
+        constexpr Plan<CountV> makeplan(std::string_view fmt)
+        {
+            size_t i = 0;
+            size_t n = 0;
+            Plan<CountV> plan = {};
+            for(i=0; i<fmt.size(); i++)
+            {
+                // only reachable with an invalid format, which sfprintf() already rejected
+                if((fmt[i] == '%') && ((n + 1) < CountV))
+                {
+                    plan.pieces[n].litend = i;
+                    plan.pieces[n].flag = fmt[i + 1];
+                    n++;
+                    plan.pieces[n].litbegin = (i + 2);
+                    i++;
+                }
+            }
+            plan.pieces[n].litend = fmt.size();
+            return plan;
+        }
+
+        // collects output on the stack, and hands it to the stream in as few writes as possible
+        class Buffer
+        {
+            private:
+                std::ostream& m_out;
+                size_t m_len;
+                char m_buf[256];
+
+            public:
+                Buffer(std::ostream& out): m_out(out), m_len(0)
+                {
+                }
+
+                ~Buffer()
+                {
+                    flush();
+                }
+
+                Buffer(const Buffer&) = delete;
+                Buffer& operator=(const Buffer&) = delete;
+
+                void flush()
+                {
+                    if(m_len > 0)
+                    {
+                        m_out.write(m_buf, m_len);
+                        m_len = 0;
+                    }
+                }
+
+                void put(char ch)
+                {
+                    if(m_len == sizeof(m_buf))
+                    {
+                        flush();
+                    }
+                    m_buf[m_len++] = ch;
+                }
+
+                void write(const char* data, size_t size)
+                {
+                    if(size > (sizeof(m_buf) - m_len))
+                    {
+                        flush();
+                        if(size > sizeof(m_buf))
                         {
-                            std::stringstream b;
-                            b << "invalid format flag '" << char(cd) << "'";
-                            throw std::runtime_error(b.str());
+                            m_out.write(data, size);
+                            return;
                         }
-                        break;
+                    }
+                    std::memcpy(m_buf + m_len, data, size);
+                    m_len += size;
                 }
-                auto subst = fmt.substr(i+2, fmt.length());
-                return sfprintf(out, subst, Fargs...);
+
+                void escaped(std::string_view str, bool wquotes)
+                {
+                    char tmp[4];
+                    for(char ch: str)
+                    {
+                        write(tmp, escapeto(tmp, (unsigned char)ch, wquotes));
+                    }
+                }
+        };
+
+        /*
+        * @returns <value> as text, as operator<< would print it.
+        * <tmp> is room for it, if it needs converting (at least 64 bytes).
+        */
+        inline std::string_view totext(const std::string& value, char*)
+        {
+            return value;
+        }
+
+        inline std::string_view totext(std::string_view value, char*)
+        {
+            return value;
+        }
+
+        inline std::string_view totext(const char* value, char*)
+        {
+            return value;
+        }
+
+        inline std::string_view totext(char value, char* tmp)
+        {
+            tmp[0] = value;
+            return std::string_view(tmp, 1);
+        }
+
+        inline std::string_view totext(bool value, char*)
+        {
+            return (value ? "1" : "0");
+        }
+
+        template<typename ValueT>
+        std::enable_if_t<std::is_integral_v<ValueT>, std::string_view> totext(ValueT value, char* tmp)
+        {
+            auto res = std::to_chars(tmp, tmp + 64, value);
+            return std::string_view(tmp, res.ptr - tmp);
+        }
+
+        template<typename ValueT>
+        std::enable_if_t<std::is_floating_point_v<ValueT>, std::string_view> totext(ValueT value, char* tmp)
+        {
+            int len;
+            len = std::snprintf(tmp, 64, "%g", double(value));
+            return std::string_view(tmp, size_t(std::max(len, 0)));
+        }
+
+        template<typename ValueT>
+        void putvalue(Buffer& buf, char flag, const ValueT& value)
+        {
+            char tmp[64];
+            std::string_view text;
+            text = totext(value, tmp);
+            if(flag == 'p')
+            {
+                buf.escaped(text, false);
+            }
+            else if(flag == 'q')
+            {
+                buf.put('"');
+                buf.escaped(text, true);
+                buf.put('"');
+            }
+            else
+            {
+                buf.write(text.data(), text.size());
+            }
+        }
+    }
+
+    /*
+    * wraps a string literal for use as a format string (see sfprintf()), so it
+    * can be checked at compile time:
+    *
+    *   Util::sfprintf(out, RMCPP_FMT("%d of %d files failed:\n"), failed, total);
+    */
+    #define RMCPP_FMT(str) \
+        ([]{ struct FmtStr { static constexpr std::string_view value() { return str; } }; return FmtStr(); }())
+
+    /**
+    * writes the format string <FmtT> (see RMCPP_FMT()) to <out>, with a value from <args>
+    * substituted for every flag:
+    *
+    *   %s %d %l %c  the value, as operator<< would print it
+    *   %p           same, but escaped as in a C string literal
+    *   %q           same, escaped and in double quotes
+    *   %%           a '%'
+    *
+    * an invalid flag, or a number of arguments that doesn't match, is a compile error.
+    */
+    template<typename FmtT, typename... Args>
+    std::ostream& sfprintf(std::ostream& out, FmtT, const Args&... args)
+    {
+        constexpr std::string_view fmt = FmtT::value();
+        // kept at 0 if invalid, so that only the static_assert fires
+        constexpr size_t nflags = size_t(std::max(Format::countflags(fmt), 0L));
+        static_assert(Format::countflags(fmt) >= 0, "invalid format flag (must be one of %s, %d, %l, %c, %p, %q, %%)");
+        static_assert(Format::countargs(fmt) == long(sizeof...(Args)), "number of arguments doesn't match the format string");
+        static constexpr Format::Plan<nflags + 1> plan = Format::makeplan<nflags + 1>(fmt);
+        size_t n;
+        Format::Buffer buf(out);
+        n = 0;
+        // literal text and '%%' up to the next flag that takes an argument, then the argument
+        auto next = [&](const auto& value)
+        {
+            while(true)
+            {
+                const Format::Piece& pc = plan.pieces[n++];
+                buf.write(fmt.data() + pc.litbegin, pc.litend - pc.litbegin);
+                if(pc.flag != '%')
+                {
+                    Format::putvalue(buf, pc.flag, value);
+                    return;
+                }
+                buf.put('%');
+            }
+        };
+        (next(args), ...);
+        // unused if there are no arguments
+        (void)next;
+        for(; n<(nflags + 1); n++)
+        {
+            const Format::Piece& pc = plan.pieces[n];
+            buf.write(fmt.data() + pc.litbegin, pc.litend - pc.litbegin);
+            if(pc.flag == '%')
+            {
+                buf.put('%');
             }
-            out << fmt[i];
         }
         return out;
     }
 
-    template<typename... Args>
-    void error(const std::string& fmtstr, Args&&... args)
+    // prints "ERROR: ", followed by <fmt> formatted as by sfprintf(), to standard error
+    template<typename FmtT, typename... Args>
+    void error(FmtT fmt, const Args&... args)
     {
-        sfprintf(std::cerr, "ERROR: ");
-        sfprintf(std::cerr, fmtstr, args...);
+        sfprintf(std::cerr, RMCPP_FMT("ERROR: "));
+        sfprintf(std::cerr, fmt, args...);
         std::cerr << std::endl;
     }
 }
 
+namespace Scan
+{
+    /*
+    * a small set of bytes a scanning kernel looks for.
+    * <table> is used by the scalar kernel, <chars> by the vectorized ones.
+    * a set of more than <maxchars> bytes still works, but only with the scalar kernel.
+    */
+    struct ByteSet
+    {
+        static constexpr int maxchars = 8;
+
+        bool table[256] = {};
+        unsigned char chars[maxchars] = {};
+        int count = 0;
+        // set once there were more bytes than fit in <chars>
+        bool overflow = false;
+
+        void add(int ch);
+    };
+
+    /**
+    * @returns a pointer to the first byte in [begin, end) that is in <set>,
+    * or <end> if there is none.
+    */
+    using FindFunc = const char*(*)(const char* begin, const char* end, const ByteSet& set);
+
+    /**
+    * @returns the fastest kernel supported by the running CPU (picked once, via CPUID).
+    */
+    FindFunc findfunc();
+
+    /**
+    * @returns the same kind of kernel as findfunc(), except that it finds the
+    * first byte that is NOT in <set> (i.e., it skips over a run of bytes in <set>).
+    */
+    FindFunc skipfunc();
+
+    /**
+    * @returns the name of the kernel returned by findfunc(), i.e., "avx2".
+    */
+    const char* kernelname();
+}
+
+/*
+* a read-only view of a file's contents.
+* on POSIX systems the file is mmap'd, elsewhere it is read into memory.
+* the mapping lives as long as the MappedFile does, so anything pointing
+* into data() must not outlive it.
+*/
+class MappedFile
+{
+    private:
+        const char* m_data;
+        size_t m_size;
+        bool m_ismapped;
+        // kept open while mapped, for fd()
+        int m_fd;
+        // only used when mmap is not available
+        std::string m_fallback;
+
+    private:
+        void release();
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /**
+        * maps the file at <path>.
+        * @returns true on success, false if the file could not be opened or mapped.
+        */
+        bool open(const std::string& path);
+
+        const char* data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        /**
+        * @returns the descriptor of the mapped file (see SpanWriter::copyfrom()),
+        * or -1 if it isn't mapped.
+        */
+        int fd() const
+        {
+            return m_fd;
+        }
+};
+
+// see stats.h
+struct StripStats;
+
+// see trace.h
+class TraceRing;
+
+/*
+* buffered output, written in as few system calls as possible.
+*
+* bytes handed to put() and write() are copied into a large, aligned buffer.
+* bytes handed to span() are not copied at all - only the pointer is kept,
+* and the bytes are written straight from there (with writev, when writing
+* to a file descriptor). this is what CommentStripper uses for runs of input
+* that survive unchanged, when reading from memory.
+*
+* pending output is flushed when the buffer or the span list fills up, when
+* flush() is called, and on destruction.
+*/
+class SpanWriter
+{
+    public:
+        // size of the copy buffer
+        static constexpr size_t buffersize = (256 * 1024);
+
+        // maximum number of pending pieces; comfortably below IOV_MAX
+        static constexpr size_t maxpieces = 512;
+
+        // spans shorter than this are copied anyway; not worth a piece of their own
+        static constexpr size_t minspanlen = 64;
+
+        /*
+        * receives everything written, piece by piece (see SpanWriter(ChunkFunc)).
+        * the data is only valid for the duration of the call.
+        * return false to fail the write.
+        */
+        using ChunkFunc = std::function<bool(const char* data, size_t size)>;
+
+    private:
+        struct Piece
+        {
+            const char* data;
+            size_t size;
+        };
+
+    private:
+        // the file descriptor to write to. -1 if writing to m_outfp
+        int m_fd;
+
+        // true if m_fd was opened by open(), and needs closing
+        bool m_ownsfd;
+
+        // the output stream to write to, if not writing to a file descriptor
+        std::ostream* m_outfp;
+
+        // the string to append to, if writing to neither
+        std::string* m_outstr;
+
+        // the function to hand pieces to, if writing to none of the above
+        ChunkFunc m_outfn;
+
+        // bytes written out so far
+        size_t m_flushed;
+
+        // the copy buffer. never reallocated, so pieces may point into it
+        char* m_buf;
+        size_t m_buflen;
+
+        // start of copied bytes not yet sealed into a piece
+        size_t m_bufmark;
+
+        Piece m_pieces[maxpieces];
+        size_t m_npieces;
+
+        // false once a write failed
+        bool m_good;
+
+        // time spent writing is added here, if set (see setStats())
+        StripStats* m_stats;
+
+    private:
+        void init();
+        void seal();
+        void addpiece(const char* data, size_t size);
+        bool writepieces();
+        void writelarge(const char* data, size_t size);
+
+    public:
+        // writes to standard output
+        SpanWriter();
+
+        // writes to file descriptor <fd>, which is not closed
+        SpanWriter(int fd);
+
+        // writes to <outfp>
+        SpanWriter(std::ostream& outfp);
+
+        // appends to <outstr>
+        SpanWriter(std::string& outstr);
+
+        /*
+        * hands everything to <fn>, in pieces of whatever size happens to be pending
+        * when the writer flushes - at most buffersize bytes, unless spans are involved.
+        * this is how stages are chained without collecting the whole output first
+        * (see Preprocessor::feed()).
+        */
+        SpanWriter(ChunkFunc fn);
+
+        ~SpanWriter();
+
+        SpanWriter(const SpanWriter&) = delete;
+        SpanWriter& operator=(const SpanWriter&) = delete;
+
+        /**
+        * (re)opens the writer to write to the file at <path>, truncating it.
+        * @returns true on success.
+        */
+        bool open(const std::string& path);
+
+        void put(char ch)
+        {
+            if(m_buflen == buffersize)
+            {
+                flush();
+            }
+            m_buf[m_buflen++] = ch;
+        }
+
+        // copies <size> bytes at <data>
+        void write(const char* data, size_t size)
+        {
+            if(size <= (buffersize - m_buflen))
+            {
+                std::memcpy(m_buf + m_buflen, data, size);
+                m_buflen += size;
+                return;
+            }
+            writelarge(data, size);
+        }
+
+        /*
+        * references <size> bytes at <data>, without copying them.
+        * <data> must stay valid until the next flush().
+        */
+        void span(const char* data, size_t size)
+        {
+            if(size < minspanlen)
+            {
+                write(data, size);
+                return;
+            }
+            seal();
+            addpiece(data, size);
+        }
+
+        /**
+        * writes everything that is pending.
+        * @returns false if this, or any prior write failed.
+        */
+        bool flush();
+
+        bool good() const
+        {
+            return m_good;
+        }
+
+        // @returns the number of bytes handed to this writer so far, including those still pending
+        size_t tell() const;
+
+        /**
+        * writes the first <size> bytes of the file open as <srcfd>, after everything pending.
+        * where possible, the data never passes through userspace: files are cloned
+        * (FICLONE) or copied in the kernel (copy_file_range, or sendfile for pipes) on Linux.
+        * @returns false if reading or writing failed.
+        */
+        bool copyfrom(int srcfd, size_t size);
+
+        /*
+        * adds the time spent actually writing to <stats>, if built with RMCPP_STATS.
+        * null to stop.
+        */
+        void setStats(StripStats* stats);
+};
+
+/*
+* what --strip does: drops every line that is empty, or nothing but whitespace, from
+* whatever is fed to it, and writes the rest to a SpanWriter.
+* CommentStripper puts it between itself and the output (see runselect()), so lines
+* that are only left blank once their comments are gone are dropped as well.
+* the only thing ever held back is the whitespace at the start of the current line.
+*/
+class BlankLineFilter
+{
+    private:
+        // true while the current line has been nothing but whitespace so far
+        bool m_blank;
+        // ... and that whitespace
+        std::string m_pending;
+        Scan::FindFunc m_findfn;
+        Scan::FindFunc m_skipfn;
+        Scan::ByteSet m_space;
+        Scan::ByteSet m_newline;
+
+    public:
+        BlankLineFilter();
+
+        /**
+        * writes whatever of [data, data+size) isn't part of a blank line to <out>.
+        * can be called as a SpanWriter::ChunkFunc.
+        * @returns false if writing to <out> failed.
+        */
+        bool feed(const char* data, size_t size, SpanWriter& out);
+
+        // the end of the input. a last line without a newline is dropped, too, if it's blank
+        void finish();
+};
+
 class CommentStripper
 {
     public:
@@ -252,6 +794,8 @@ class CommentStripper
             // this will NOT WORK with many shell or perl scripts, as it
             // does not, nor ever will, support heredocs, et cetera.
             CT_HASHCOMM,
+            // inside a "string" or 'char' literal
+            CT_LITERAL,
         };
 
         struct Options
@@ -262,7 +806,7 @@ class CommentStripper
             //! is RemCom allowed to explain? default: no
             bool use_debugmessages = false;
 
-            //! remove remaining whitespace? default: no
+            //! remove lines that are blank, or left blank once comments are gone? default: no
             bool remove_emptylines = false;
 
             //! remove C++-style comments? default: yes
@@ -279,19 +823,156 @@ class CommentStripper
 
             bool do_convertcpp = false;
 
+            /*
+            * collapse every run of spaces and tabs outside of literals into a single space,
+            * and drop the ones at the end of a line? default: no.
+            * newlines are always kept, so preprocessor lines stay intact.
+            */
+            bool do_minify = false;
+
+            //! with do_minify, drop indentation altogether, rather than leaving one space? default: no
+            bool minify_dropindent = false;
+
+            /*
+            * run a copy of the parser compiled for exactly the flags above? default: yes.
+            * the output is the same either way; this only exists to measure the difference
+            * (rmcppbench), and to test that it is the same (RMCPP_GENERIC=1, see make test).
+            */
+            bool use_specialized = true;
+
             // infilename is only used for diagnostics
             std::string infilename = "<stdin>";
+
+            /**
+            * @returns every option that affects the output, as a string.
+            * infilename is left out, since it only shows up in messages.
+            * used to key cached results (see ResultCache), so any new option that
+            * changes the output has to be added here, too.
+            */
+            std::string serialize() const;
         };
 
         using OnCommentCallback = std::function<bool(State, char)>;
 
+        /*
+        * a whole comment, as handed to range callbacks (see onCommentRange()).
+        * the range covers the comment exactly as it appears in the input, delimiters
+        * included, but not the newline that ends a line comment.
+        */
+        struct CommentInfo
+        {
+            // one of CT_CPPCOMM, CT_ANSICOMM, CT_PASCALCOMM, CT_HASHCOMM
+            State kind = CT_UNDEF;
+
+            // position of the first byte in the input, and the number of bytes (carriage returns included)
+            size_t offset = 0;
+            size_t length = 0;
+
+            // line and column of the first and the last character
+            long startline = 0;
+            long startcol = 0;
+            long endline = 0;
+            long endcol = 0;
+
+            // the comment itself. only valid for the duration of the callback
+            std::string_view text;
+        };
+
+        /*
+        * called once per comment. return false to stop receiving comments.
+        */
+        using OnCommentRangeCallback = std::function<bool(const CommentInfo&)>;
+
+        /*
+        * everything about the parser's state that carries over from one line to
+        * the next. at the start of a line (that is, right after a '\n'), this plus
+        * the line number is all that's needed to resume parsing from there.
+        * used by ParallelStripper.
+        */
+        struct Snapshot
+        {
+            State state = CT_UNDEF;
+            int pascalnest = 0;
+            bool pascalbrace = false;
+            bool incomment = false;
+            // only meaningful if state is CT_LITERAL
+            int quote = 0;
+            bool escaped = false;
+            long litline = 0;
+            long litcol = 0;
+            // see m_minspace and m_minline. only meaningful with Options::do_minify
+            bool minspace = false;
+            bool minline = true;
+
+            bool operator==(const Snapshot& other) const;
+        };
+
+        // the state at the start of a line, and how much output had been produced until then
+        struct Checkpoint
+        {
+            size_t offset;
+            Snapshot snap;
+            size_t outlen;
+            size_t diaglen;
+        };
+
+        /*
+        * controls how run() handles a chunk of the input, rather than the whole thing.
+        * see ParallelStripper.
+        */
+        struct ChunkControl
+        {
+            // if false, the end of the input isn't the end of the file
+            bool islast = false;
+
+            // if set, a checkpoint is recorded here at the first line start after every <interval> bytes
+            std::vector<Checkpoint>* record = nullptr;
+            size_t interval = 0;
+            size_t lastrecord = 0;
+
+            /*
+            * if set, run() stops as soon as its state at the start of a line matches one of
+            * these checkpoints; <converged> is then the index of that checkpoint.
+            * likewise, it gives up after <budget> bytes (if nonzero), setting <gaveup>.
+            */
+            const std::vector<Checkpoint>* match = nullptr;
+            size_t matchidx = 0;
+            size_t budget = 0;
+            size_t startoffset = 0;
+            long converged = -1;
+            bool gaveup = false;
+
+            // where the diagnostics of this run go, to record their length in checkpoints
+            std::ostream* diagfp = nullptr;
+        };
+
+        // how much of a stream is read at once. this is all of the input that is kept in memory
+        static constexpr size_t streambufsize = (64 * 1024);
+
     private:
         // parser options
         Options m_opts;
 
-        // the input stream handle
+        // the input stream handle. null if reading from memory
         std::istream* m_infp;
 
+        /*
+        * the input range. if reading from memory (i.e., a mapped file), that's all of it.
+        * if reading from a stream, it's whatever part of m_inbuf was read last;
+        * m_inoffset is the offset of m_inbegin in the stream (always 0 for memory).
+        */
+        const char* m_inbegin;
+        const char* m_incur;
+        const char* m_inend;
+        size_t m_inoffset;
+
+        /*
+        * the buffer a stream is read into, streambufsize bytes at a time.
+        * once it's used up, refill() reads the next lot over it; nothing older is kept.
+        */
+        std::vector<char> m_inbuf;
+        bool m_ineof;
+
         // current state the parser is in
         State m_state;
         
@@ -319,39 +1000,312 @@ class CommentStripper
         // true if we're inside a comment
         bool m_incomment;
 
+        // the kind of literal (quote character) we're inside of, if m_state is CT_LITERAL
+        int m_quote;
+
+        // true if the previous character in the literal was an unescaped backslash
+        bool m_escaped;
+
+        // where the current literal started
+        long m_litline;
+        long m_litcol;
+
+        // non-null if only processing a chunk of the input (see ParallelStripper)
+        ChunkControl* m_chunk;
+
         OnCommentCallback m_oncommentcb;
 
+        OnCommentRangeCallback m_oncommentrangecb;
+
+        // true while a range callback wants comments
+        bool m_tracking;
+
+        // the comment currently being read, if m_tracking is set
+        CommentInfo m_comment;
+
+        // offset of its last byte so far
+        size_t m_commlast;
+
+        /*
+        * a stream can't be looked back into, so when reading from one, the raw bytes
+        * of the current comment are collected in m_captured while m_capturing is set.
+        */
+        bool m_capturing;
+        std::string m_captured;
+
+        // where warnings and debug messages go. default: std::cerr
+        std::ostream* m_diagfp;
+
+        /*
+        * run() uses these to skip straight to the next byte that matters for the
+        * current state, instead of going through more() for every single byte.
+        */
+        Scan::FindFunc m_findfn;
+        // bytes that matter outside of comments and literals
+        Scan::ByteSet m_scancode;
+        // ... inside C comments
+        Scan::ByteSet m_scanansi;
+        // ... inside C++ and hash comments
+        Scan::ByteSet m_scanline;
+        // ... inside pascal comments
+        Scan::ByteSet m_scanpascal;
+        // ... inside string and char literals
+        Scan::ByteSet m_scanliteral;
+
+        // for --minify: finds the end of a run of m_scanspace
+        Scan::FindFunc m_skipfn;
+        Scan::ByteSet m_scanspace;
+
+        /*
+        * for --minify: m_minspace is set while a run of whitespace is held back, to be
+        * written as one space before whatever code comes next. m_minline is set while
+        * nothing but whitespace has been written on the current line.
+        */
+        bool m_minspace;
+        bool m_minline;
+
+        // counters for --stats, if set. only updated if built with RMCPP_STATS (see stats.h)
+        StripStats* m_stats;
+
+        // what --debug records, and dumps on warnings and at the end (see trace.h). null otherwise
+        TraceRing* m_trace;
+
+        /*
+        * what runselect() puts between runimpl() and the output for --strip, and the output
+        * of the run in progress. set up on first use, and kept from then on, so running
+        * again after reset() doesn't set up another.
+        */
+        BlankLineFilter* m_filter;
+        SpanWriter* m_filtered;
+        SpanWriter* m_filterout;
+
     private:
         void initdefaults();
+        void initscanner();
 
-        template<typename... Args>
-        void dbg(const std::string& fmtstr, Args&&... args)
-        {
-            if(m_opts.use_debugmessages)
-            {
-                Util::sfprintf(std::cerr, ">>>>[%s:%d:%d]: ", m_opts.infilename, m_posline, m_poscol);
-                Util::sfprintf(std::cerr, fmtstr, args...);
-                std::cerr << std::endl;
-            }
-        }
+        /*
+        * adds a record of <kind> (a TraceRing::Kind) to m_trace, which must be set.
+        * <state> is the state the record is about; for TR_STATE, the one just left.
+        * defined in engine.h.
+        */
+        void trace(uint8_t kind, State state, uint32_t aux);
 
-        template<typename... Args>
-        void warn(const std::string& fmtstr, Args&&... args)
+        // writes out whatever m_trace recorded since the last time, if set
+        void dumptrace();
+
+        // prints a warning, formatted as by Util::sfprintf(), unless they're turned off
+        template<typename FmtT, typename... Args>
+        void warn(FmtT fmt, const Args&... args)
         {
             if(m_opts.use_warningmessages)
             {
-                Util::sfprintf(std::cerr, "WARNING: [%p:%d:%d]: ", m_opts.infilename, m_posline, m_poscol);
-                Util::sfprintf(std::cerr, fmtstr, args...);
-                std::cerr << std::endl;
+                // what led up to it
+                dumptrace();
+                Util::sfprintf(*m_diagfp, RMCPP_FMT("WARNING: [%p:%d:%d]: "), m_opts.infilename, m_posline, m_poscol);
+                Util::sfprintf(*m_diagfp, fmt, args...);
+                (*m_diagfp) << std::endl;
             }
         }
 
-        bool is_space();
         bool is_pascalcomm_begin();
-        void do_skipemptylines();
 
         void forward_comment(State st, char ch);
         void forward_comment(State st, const std::string& str);
+        void forward_comment(State st, const char* str, size_t len);
+
+        /*
+        * skips bytes not in <set>, updating m_prevch, m_currch and m_poscol
+        * as if they had been read through more().
+        * when reading from a stream, this stops at the end of m_inbuf, and never refills it.
+        * @returns the number of bytes skipped; they start at (m_incur - count).
+        */
+        size_t skipahead(const Scan::ByteSet& set);
+
+        /**
+        * reads the next part of the stream into m_inbuf.
+        * @returns false at the end of the stream.
+        */
+        bool refill();
+
+        /*
+        * hands <size> bytes of the input at <data> to <out>: as a span when reading from
+        * memory, copied when reading from a stream, since m_inbuf may be refilled before <out> is flushed.
+        */
+        void emit(SpanWriter& out, const char* data, size_t size)
+        {
+            if(m_infp == nullptr)
+            {
+                out.span(data, size);
+            }
+            else
+            {
+                out.write(data, size);
+            }
+        }
+
+        /*
+        * hands code (i.e., anything outside of comments and literals) to <out>: as is
+        * through emit(), or through minify() if ModeT says so. defined in engine.h.
+        */
+        template<typename ModeT>
+        void putcode(SpanWriter& out, const char* data, size_t size);
+        template<typename ModeT>
+        void putcode(SpanWriter& out, char ch);
+
+        // writes code to <out>, with its whitespace collapsed (see Options::do_minify)
+        void minify(SpanWriter& out, const char* data, size_t size);
+        void minify(SpanWriter& out, char ch);
+
+        // writes the whitespace held back by minify(), if any
+        void minifyflush(SpanWriter& out)
+        {
+            if(m_minspace)
+            {
+                out.put(' ');
+                m_minspace = false;
+            }
+        }
+
+        // @returns the offset of m_currch in the input
+        size_t curoffset() const
+        {
+            return ((m_inoffset + (m_incur - m_inbegin)) - 1);
+        }
+
+        /*
+        * @returns the column of m_currch, counting from 1.
+        * more() counts the newline itself as the first column of the new line,
+        * so m_poscol is one ahead on every line but the first.
+        */
+        long curcolumn() const
+        {
+            return ((m_posline > 1) ? (m_poscol - 1) : m_poscol);
+        }
+
+        // a comment of kind <kind> might start at m_currch
+        void markcomment(State kind);
+
+        // m_currch is part of the current comment
+        void notecomment()
+        {
+            m_commlast = curoffset();
+            m_comment.endline = m_posline;
+            m_comment.endcol = curcolumn();
+        }
+
+        // hands the current comment to <sink>
+        template<typename SinkT>
+        void endcomment(SinkT& sink);
+
+        /*
+        * update m_stats, if set. defined in engine.h; empty unless built with RMCPP_STATS,
+        * in which case they're gone from runimpl() altogether.
+        */
+        // <count> more bytes were read in the current state
+        void statbytes(size_t count);
+        // the current state was just entered
+        void statenter();
+        // m_pascalnest went up
+        void statnesting();
+        // the input was read to the end
+        void statinput();
+
+        /*
+        * the options that runimpl() checks for (nearly) every byte, as compile-time constants.
+        * run() picks the instantiation matching m_opts once (see dispatch()), so the checks
+        * for modes that are off are gone from the loop altogether.
+        */
+        template<bool HashV, bool PascalV, bool ConvertV, bool MinifyV>
+        struct FixedMode
+        {
+            static constexpr bool hashcomments(const Options&)
+            {
+                return HashV;
+            }
+
+            static constexpr bool pascalcomments(const Options&)
+            {
+                return PascalV;
+            }
+
+            static constexpr bool convertcpp(const Options&)
+            {
+                return ConvertV;
+            }
+
+            static constexpr bool minify(const Options&)
+            {
+                return MinifyV;
+            }
+        };
+
+        // the same, looked up at runtime. used if Options::use_specialized is off
+        struct RuntimeMode
+        {
+            static bool hashcomments(const Options& opts)
+            {
+                return opts.remove_hashcomments;
+            }
+
+            static bool pascalcomments(const Options& opts)
+            {
+                return opts.remove_pascalcomments;
+            }
+
+            static bool convertcpp(const Options& opts)
+            {
+                return opts.do_convertcpp;
+            }
+
+            static bool minify(const Options& opts)
+            {
+                return opts.do_minify;
+            }
+        };
+
+        /*
+        * the actual parser. defined in engine.h.
+        * <sink> is called for every comment if m_tracking is set; see run(SpanWriter&, SinkT&&).
+        * <ModeT> is FixedMode or RuntimeMode.
+        */
+        template<typename ModeT, typename SinkT>
+        bool runimpl(SpanWriter& out, SinkT& sink);
+
+        /*
+        * calls runimpl() with the FixedMode matching m_opts, one flag per
+        * recursion: <FlagsV> are the ones picked so far.
+        */
+        template<typename SinkT, bool... FlagsV>
+        bool dispatch(SpanWriter& out, SinkT& sink);
+
+        // dispatch(), or runimpl<RuntimeMode>(), depending on m_opts.use_specialized
+        template<typename SinkT>
+        bool runmode(SpanWriter& out, SinkT& sink);
+
+        // runmode(), through a BlankLineFilter if m_opts.remove_emptylines is set
+        template<typename SinkT>
+        bool runselect(SpanWriter& out, SinkT& sink);
+
+        bool ispartial() const
+        {
+            return ((m_chunk != nullptr) && !m_chunk->islast);
+        }
+
+        /*
+        * called by run() at the start of every line, if m_chunk is set.
+        * @returns false if run() should stop here.
+        */
+        bool chunkpoint(SpanWriter& out);
+
+        Snapshot snapshot() const;
+
+        /*
+        * prepares to process the chunk [begin, end) of the input, starting at the beginning
+        * of line <line>, in state <snap>.
+        */
+        void beginchunk(const char* begin, const char* end, long line, const Snapshot& snap, ChunkControl* ctl);
+
+        friend class ParallelStripper;
 
     public:
         /*
@@ -371,9 +1325,43 @@ class CommentStripper
         *   }
         *
         * in other words, the input-stream does NOT need to be new'd.
+        *
+        * the stream is read in blocks of streambufsize bytes, so it can be of any length.
         */
         CommentStripper(const Options& opts, std::istream* infp);
 
+        /*
+        * reads from the memory in [data, data+size), instead of a stream.
+        * this is much faster than going through std::istream, and is what
+        * main.cpp uses for named input files (see MappedFile).
+        * the memory is not copied, so it must outlive the CommentStripper.
+        */
+        CommentStripper(const Options& opts, const char* data, size_t size);
+
+        ~CommentStripper();
+
+        /*
+        * starts over on the memory in [data, data+size), as if just constructed with it.
+        * options, callbacks, the diagnostic stream and stats are kept, and so are the
+        * buffers, so this is much cheaper than a new CommentStripper (see SnippetStripper).
+        */
+        void reset(const char* data, size_t size);
+
+        CommentStripper(const CommentStripper&) = delete;
+        CommentStripper& operator=(const CommentStripper&) = delete;
+
+        // @returns the name of <st>, as used in debug output
+        static const char* statename(State st);
+
+        /**
+        * a quick look (using the vectorized kernels) at [data, data+size), for files without comments.
+        * @returns true if stripping it with <opts> would leave it exactly as it is, without any
+        * warnings: nothing outside of literals could start a comment, there are no carriage
+        * returns, and every literal is closed. the input can then simply be copied
+        * (see SpanWriter::copyfrom()). false only means it takes run() to tell.
+        */
+        static bool isverbatim(const Options& opts, const char* data, size_t size);
+
         /**
         * populates m_currchar with the current character in the stream cursor,
         * m_prevchar with the prior value of m_currchar, and m_peekch with the
@@ -389,12 +1377,111 @@ class CommentStripper
         */
         int peek();
 
+        /*
+        * <cb> is called for every byte of every comment, followed by a call with CT_UNDEF
+        * once the comment is over.
+        */
         void onComment(OnCommentCallback cb);
 
+        /*
+        * <cb> is called once for every comment, with its position and text.
+        * much cheaper than onComment(), which makes an indirect call for every byte.
+        */
+        void onCommentRange(OnCommentRangeCallback cb);
+
+        /*
+        * redirects warnings and debug messages to <fp> (default: std::cerr).
+        * the batch mode uses this to collect messages per file.
+        */
+        void setDiagStream(std::ostream* fp);
+
+        /*
+        * counts bytes, comments and literals into <stats> (see stats.h).
+        * only does anything if built with RMCPP_STATS.
+        */
+        void setStats(StripStats* stats);
+
         /**
         * @param outfp the std::ostream-compatible output-stream to write to.
         * @returns true if no errors occured, false otherwise.
         */
         bool run(std::ostream& outfp);
+
+        /**
+        * like run(std::ostream&), but writes through <out>.
+        * when reading from memory, runs of input that are kept as-is are handed
+        * to <out> as spans, rather than copied. <out> is flushed before returning.
+        * @returns true if no errors occured (including write errors), false otherwise.
+        */
+        bool run(SpanWriter& out);
+
+        /**
+        * like run(SpanWriter&), but calls <sink> (anything callable as
+        * bool(const CommentInfo&)) for every comment, as onCommentRange() does.
+        * since the type of <sink> is known at compile time, the call can be inlined.
+        * defined in engine.h, which has to be included to use this.
+        * @returns true if no errors occured (including write errors), false otherwise.
+        */
+        template<typename SinkT>
+        bool run(SpanWriter& out, SinkT&& sink);
+};
+
+/*
+* strips a single in-memory input on several threads, with output identical to
+* that of CommentStripper.
+*
+* the input is split into chunks at line boundaries. every chunk is first stripped
+* speculatively - assuming it starts outside of any comment, recording checkpoints
+* along the way - and then again from each other state it could plausibly start in
+* (inside a C or Pascal comment), until that run's state matches one of the
+* checkpoints: from there on, both runs are necessarily identical, so only the
+* differing prefix needs to be kept.
+* once the real state at the end of each chunk is known, the matching runs are
+* stitched together in order. if none of them matches (say, a chunk starts inside a
+* string literal, or a nested pascal comment), that chunk is redone from its real
+* state, again only until it converges.
+*
+* comment callbacks are not supported; use CommentStripper for that.
+*/
+class ParallelStripper
+{
+    public:
+        // chunks smaller than this aren't worth a thread
+        static constexpr size_t minchunksize = (1024 * 1024);
+
+        // distance between checkpoints
+        static constexpr size_t checkpointinterval = (16 * 1024);
+
+        // speculative runs give up after this many bytes without converging
+        static constexpr size_t speculationbudget = (256 * 1024);
+
+    private:
+        struct Run;
+        struct Chunk;
+
+    private:
+        CommentStripper::Options m_opts;
+        const char* m_data;
+        size_t m_size;
+        size_t m_nthreads;
+        std::ostream* m_diagfp;
+
+    private:
+        void splitchunks(std::vector<Chunk>& chunks);
+        void runchunk(Chunk& ck);
+        bool runone(Chunk& ck, Run& rn, const CommentStripper::Snapshot& entry, bool primary, size_t budget);
+
+    public:
+        /*
+        * <nthreads> of 0 means one thread per core.
+        */
+        ParallelStripper(const CommentStripper::Options& opts, const char* data, size_t size, size_t nthreads);
+
+        void setDiagStream(std::ostream* fp);
+
+        /**
+        * @returns true if no errors occured, false otherwise - just like CommentStripper::run().
+        */
+        bool run(SpanWriter& out);
 };
 
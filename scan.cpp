@@ -0,0 +1,259 @@
+/*
+* vectorized byte scanning.
+*
+* all kernels do the same thing: find the first byte in a range that is
+* part of a (small) set of bytes - or, with <NotV> set, the first one that isn't. the best kernel for the running CPU is
+* picked once, on first use. setting the environment variable RMCPP_SCAN
+* to one of "scalar", "sse2", "avx2", "avx512" forces a specific kernel
+* (as long as the CPU supports it), which is mostly useful for testing.
+* anything else is complained about, and ignored.
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include "rmcpp.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define RMCPP_SCAN_X86 1
+    #include <immintrin.h>
+#endif
+
+namespace Scan
+{
+    void ByteSet::add(int ch)
+    {
+        if(table[(unsigned char)ch])
+        {
+            return;
+        }
+        table[(unsigned char)ch] = true;
+        if(count == maxchars)
+        {
+            // the vectorized kernels can't take it; see usevector()
+            overflow = true;
+            return;
+        }
+        chars[count] = (unsigned char)ch;
+        count++;
+    }
+
+    // @returns false if <set> has to go through the scalar kernel
+    static inline bool usevector(const ByteSet& set)
+    {
+        return ((set.count > 0) && !set.overflow);
+    }
+
+    template<bool NotV>
+    static const char* find_scalar(const char* begin, const char* end, const ByteSet& set)
+    {
+        while((begin < end) && (set.table[(unsigned char)*begin] == NotV))
+        {
+            begin++;
+        }
+        return begin;
+    }
+
+    #if defined(RMCPP_SCAN_X86)
+
+    template<bool NotV>
+    __attribute__((target("sse2")))
+    static const char* find_sse2(const char* begin, const char* end, const ByteSet& set)
+    {
+        int i;
+        int mask;
+        __m128i blk;
+        __m128i hit;
+        __m128i needles[ByteSet::maxchars];
+        if(!usevector(set))
+        {
+            return find_scalar<NotV>(begin, end, set);
+        }
+        for(i=0; i<set.count; i++)
+        {
+            needles[i] = _mm_set1_epi8(char(set.chars[i]));
+        }
+        while((end - begin) >= 16)
+        {
+            blk = _mm_loadu_si128((const __m128i*)begin);
+            hit = _mm_cmpeq_epi8(blk, needles[0]);
+            for(i=1; i<set.count; i++)
+            {
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(blk, needles[i]));
+            }
+            mask = _mm_movemask_epi8(hit);
+            if(NotV)
+            {
+                mask = (~mask & 0xffff);
+            }
+            if(mask != 0)
+            {
+                return begin + __builtin_ctz(mask);
+            }
+            begin += 16;
+        }
+        return find_scalar<NotV>(begin, end, set);
+    }
+
+    template<bool NotV>
+    __attribute__((target("avx2")))
+    static const char* find_avx2(const char* begin, const char* end, const ByteSet& set)
+    {
+        int i;
+        unsigned int mask;
+        __m256i blk;
+        __m256i hit;
+        __m256i needles[ByteSet::maxchars];
+        if(!usevector(set))
+        {
+            return find_scalar<NotV>(begin, end, set);
+        }
+        for(i=0; i<set.count; i++)
+        {
+            needles[i] = _mm256_set1_epi8(char(set.chars[i]));
+        }
+        while((end - begin) >= 32)
+        {
+            blk = _mm256_loadu_si256((const __m256i*)begin);
+            hit = _mm256_cmpeq_epi8(blk, needles[0]);
+            for(i=1; i<set.count; i++)
+            {
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(blk, needles[i]));
+            }
+            mask = (unsigned int)_mm256_movemask_epi8(hit);
+            if(NotV)
+            {
+                mask = ~mask;
+            }
+            if(mask != 0)
+            {
+                return begin + __builtin_ctz(mask);
+            }
+            begin += 32;
+        }
+        return find_sse2<NotV>(begin, end, set);
+    }
+
+    template<bool NotV>
+    __attribute__((target("avx512f,avx512bw")))
+    static const char* find_avx512(const char* begin, const char* end, const ByteSet& set)
+    {
+        int i;
+        size_t left;
+        __mmask64 mask;
+        __mmask64 valid;
+        __m512i blk;
+        __m512i needles[ByteSet::maxchars];
+        if(!usevector(set))
+        {
+            return find_scalar<NotV>(begin, end, set);
+        }
+        for(i=0; i<set.count; i++)
+        {
+            needles[i] = _mm512_set1_epi8(char(set.chars[i]));
+        }
+        while(begin < end)
+        {
+            left = end - begin;
+            valid = ~__mmask64(0);
+            if(left < 64)
+            {
+                // masked load for the tail, so there's no need for a scalar loop
+                valid = (__mmask64(1) << left) - 1;
+            }
+            blk = _mm512_maskz_loadu_epi8(valid, begin);
+            mask = 0;
+            for(i=0; i<set.count; i++)
+            {
+                mask |= _mm512_cmpeq_epi8_mask(blk, needles[i]);
+            }
+            if(NotV)
+            {
+                mask = ~mask;
+            }
+            mask &= valid;
+            if(mask != 0)
+            {
+                return begin + __builtin_ctzll(mask);
+            }
+            if(left < 64)
+            {
+                break;
+            }
+            begin += 64;
+        }
+        return end;
+    }
+
+    #endif
+
+    struct Kernel
+    {
+        const char* name;
+        FindFunc func;
+        FindFunc skipfunc;
+    };
+
+    static Kernel pickkernel()
+    {
+        const char* want;
+        std::string forced;
+        want = std::getenv("RMCPP_SCAN");
+        if(want != nullptr)
+        {
+            forced = want;
+        }
+        // only ever called once, so this is only said once, too
+        if(!forced.empty() && (forced != "scalar") && (forced != "sse2") && (forced != "avx2") && (forced != "avx512"))
+        {
+            Util::sfprintf(std::cerr,
+                RMCPP_FMT("WARNING: ignoring RMCPP_SCAN=%q (not one of scalar, sse2, avx2, avx512)\n"), forced);
+            forced.clear();
+        }
+        #if defined(RMCPP_SCAN_X86)
+        __builtin_cpu_init();
+        if(forced.empty() || (forced == "avx512"))
+        {
+            if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+            {
+                return {"avx512", find_avx512<false>, find_avx512<true>};
+            }
+        }
+        if(forced.empty() || (forced == "avx512") || (forced == "avx2"))
+        {
+            if(__builtin_cpu_supports("avx2"))
+            {
+                return {"avx2", find_avx2<false>, find_avx2<true>};
+            }
+        }
+        if(forced != "scalar")
+        {
+            if(__builtin_cpu_supports("sse2"))
+            {
+                return {"sse2", find_sse2<false>, find_sse2<true>};
+            }
+        }
+        #endif
+        return {"scalar", find_scalar<false>, find_scalar<true>};
+    }
+
+    static const Kernel& kernel()
+    {
+        static const Kernel k = pickkernel();
+        return k;
+    }
+
+    FindFunc findfunc()
+    {
+        return kernel().func;
+    }
+
+    FindFunc skipfunc()
+    {
+        return kernel().skipfunc;
+    }
+
+    const char* kernelname()
+    {
+        return kernel().name;
+    }
+}
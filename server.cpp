@@ -0,0 +1,515 @@
+/*
+* StripServer - see server.h
+*/
+
+#include <csignal>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/time.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+#include "server.h"
+#include "engine.h"
+
+// how often (in milliseconds) blocked threads check whether the server is shutting down
+static constexpr int pollinterval = 250;
+
+// how long (in seconds) a worker waits for the rest of a request that has started to come in
+static constexpr int requesttimeout = 10;
+
+static volatile std::sig_atomic_t g_interrupted = 0;
+
+static void oninterrupt(int)
+{
+    g_interrupted = 1;
+}
+
+StripServer::ResultLRU::ResultLRU(uint64_t maxsize): m_maxsize(maxsize), m_cursize(0)
+{
+}
+
+uint64_t StripServer::ResultLRU::sizeof_result(const Result& res)
+{
+    return (res.output.size() + res.comments.size() + res.messages.size() + sizeof(Result));
+}
+
+std::shared_ptr<const StripServer::Result> StripServer::ResultLRU::get(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_map.find(key);
+    if(it == m_map.end())
+    {
+        return nullptr;
+    }
+    // most recently used goes to the front
+    m_order.splice(m_order.begin(), m_order, it->second);
+    return it->second->second;
+}
+
+void StripServer::ResultLRU::put(const std::string& key, std::shared_ptr<const Result> res)
+{
+    uint64_t size;
+    size = sizeof_result(*res);
+    // anything that would push everything else out isn't worth keeping
+    if((m_maxsize == 0) || (size > (m_maxsize / 4)))
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_map.find(key);
+    if(it != m_map.end())
+    {
+        // another worker got there first
+        m_cursize -= sizeof_result(*it->second->second);
+        m_order.erase(it->second);
+        m_map.erase(it);
+    }
+    m_order.emplace_front(key, res);
+    m_map[key] = m_order.begin();
+    m_cursize += size;
+    while(m_cursize > m_maxsize)
+    {
+        auto& last = m_order.back();
+        m_cursize -= sizeof_result(*last.second);
+        m_map.erase(last.first);
+        m_order.pop_back();
+    }
+}
+
+StripServer::StripServer(const std::string& sockpath, size_t nthreads, uint64_t lrusize):
+    m_sockpath(sockpath), m_nthreads(nthreads), m_listenfd(-1), m_lru(lrusize), m_stopping(false)
+{
+    m_wakefds[0] = -1;
+    m_wakefds[1] = -1;
+    if(m_nthreads == 0)
+    {
+        m_nthreads = std::thread::hardware_concurrency();
+        if(m_nthreads == 0)
+        {
+            m_nthreads = 1;
+        }
+    }
+}
+
+CommentStripper::Options StripServer::makeoptions(uint32_t flags)
+{
+    CommentStripper::Options opts;
+    opts.use_warningmessages = !(flags & Protocol::RF_NOWARNINGS);
+    opts.use_debugmessages = (flags & Protocol::RF_DEBUG);
+    opts.remove_emptylines = (flags & Protocol::RF_STRIP);
+    opts.remove_ansicomments = !(flags & Protocol::RF_KEEPANSI);
+    opts.remove_cppcomments = !(flags & Protocol::RF_KEEPCPP);
+    opts.remove_pascalcomments = (flags & Protocol::RF_PASCAL);
+    opts.remove_hashcomments = (flags & Protocol::RF_HASH);
+    opts.do_minify = (flags & (Protocol::RF_MINIFY | Protocol::RF_MINIFYINDENT));
+    opts.minify_dropindent = (flags & Protocol::RF_MINIFYINDENT);
+    // same as --convert-cpp: does not remove anything
+    if(flags & Protocol::RF_CONVERTCPP)
+    {
+        opts.do_convertcpp = true;
+        opts.remove_ansicomments = false;
+        opts.remove_cppcomments = false;
+        opts.remove_hashcomments = false;
+        opts.remove_pascalcomments = false;
+    }
+    return opts;
+}
+
+void StripServer::strip(uint32_t flags, const char* data, size_t size, const std::string& infilename, Result& res)
+{
+    bool ok;
+    std::ostringstream diag;
+    CommentStripper::Options opts;
+    opts = makeoptions(flags);
+    opts.infilename = infilename;
+    {
+        SpanWriter out(res.output);
+        CommentStripper cs(opts, data, size);
+        cs.setDiagStream(&diag);
+        if(flags & Protocol::RF_COMMENTS)
+        {
+            // the same format as --writecomments
+            ok = cs.run(out, [&](const CommentStripper::CommentInfo& ci)
+            {
+                res.comments.append(ci.text.data(), ci.text.size());
+                res.comments.push_back('\n');
+                return true;
+            });
+        }
+        else
+        {
+            ok = cs.run(out);
+        }
+        out.flush();
+    }
+    res.status = (ok ? Protocol::RS_OK : Protocol::RS_FAILED);
+    res.messages = diag.str();
+}
+
+#if defined(_WIN32)
+
+bool StripServer::run()
+{
+    Util::error(RMCPP_FMT("--serve is not supported on this platform"));
+    return false;
+}
+
+#else
+
+/*
+* the cache key for a file: its path, modification time, size, and the flags.
+* the flags go in as-is, rather than through Options::serialize(), since they also
+* say whether comments were asked for.
+*/
+static std::string lrukey(const std::string& path, const struct stat& st, uint32_t flags)
+{
+    char buf[96];
+    #if defined(__APPLE__)
+    const struct timespec& mtime = st.st_mtimespec;
+    #else
+    const struct timespec& mtime = st.st_mtim;
+    #endif
+    std::snprintf(buf, sizeof(buf), "%llx.%lx:%llx:%x:",
+        (unsigned long long)mtime.tv_sec, (unsigned long)mtime.tv_nsec,
+        (unsigned long long)st.st_size, unsigned(flags));
+    return (buf + path);
+}
+
+static bool samefile(const struct stat& a, const struct stat& b)
+{
+    #if defined(__APPLE__)
+    const struct timespec& amtime = a.st_mtimespec;
+    const struct timespec& bmtime = b.st_mtimespec;
+    #else
+    const struct timespec& amtime = a.st_mtim;
+    const struct timespec& bmtime = b.st_mtim;
+    #endif
+    return (
+        (a.st_dev == b.st_dev) && (a.st_ino == b.st_ino) && (a.st_size == b.st_size) &&
+        (amtime.tv_sec == bmtime.tv_sec) && (amtime.tv_nsec == bmtime.tv_nsec)
+    );
+}
+
+bool StripServer::listen()
+{
+    int fd;
+    struct stat st;
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(m_sockpath.size() >= sizeof(addr.sun_path))
+    {
+        Util::error(RMCPP_FMT("socket path %q is too long"), m_sockpath);
+        return false;
+    }
+    std::memcpy(addr.sun_path, m_sockpath.c_str(), m_sockpath.size() + 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+    {
+        Util::error(RMCPP_FMT("cannot create socket: %s"), std::strerror(errno));
+        return false;
+    }
+    /*
+    * a socket left behind by a server that didn't exit cleanly is removed.
+    * one that still answers belongs to a running server, though.
+    */
+    if(::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+    {
+        Util::error(RMCPP_FMT("there already is a server listening on %q"), m_sockpath);
+        ::close(fd);
+        return false;
+    }
+    ::close(fd);
+    if(::lstat(m_sockpath.c_str(), &st) == 0)
+    {
+        // and anything that isn't a socket is left alone
+        if(!S_ISSOCK(st.st_mode))
+        {
+            Util::error(RMCPP_FMT("%q exists, and is not a socket"), m_sockpath);
+            return false;
+        }
+        ::unlink(m_sockpath.c_str());
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if((fd == -1) || (::bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) || (::listen(fd, SOMAXCONN) == -1))
+    {
+        Util::error(RMCPP_FMT("cannot listen on %q: %s"), m_sockpath, std::strerror(errno));
+        if(fd != -1)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    m_listenfd = fd;
+    return true;
+}
+
+void StripServer::work()
+{
+    int fd;
+    char wake;
+    wake = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_queuemtx);
+            m_queuecv.wait(lock, [&]{ return (m_stopping || !m_queue.empty()); });
+            if(m_queue.empty())
+            {
+                return;
+            }
+            fd = m_queue.front();
+            m_queue.pop_front();
+        }
+        if(!serve(fd))
+        {
+            ::close(fd);
+            continue;
+        }
+        // back to run(), until the client asks for something else
+        {
+            std::lock_guard<std::mutex> lock(m_queuemtx);
+            m_idle.push_back(fd);
+        }
+        // the pipe is nonblocking; a full one wakes run() up just as well
+        while((::write(m_wakefds[1], &wake, 1) == -1) && (errno == EINTR))
+        {
+        }
+    }
+}
+
+std::shared_ptr<const StripServer::Result> StripServer::process(uint32_t flags, uint32_t kind, const std::string& payload, const std::string& displayname)
+{
+    std::string key;
+    std::string name;
+    struct stat before;
+    struct stat after;
+    std::shared_ptr<Result> res;
+    std::shared_ptr<const Result> cached;
+    res = std::make_shared<Result>();
+    if(kind == Protocol::RK_INLINE)
+    {
+        strip(flags, payload.data(), payload.size(), (displayname.empty() ? "<stdin>" : displayname), *res);
+        return res;
+    }
+    if(kind != Protocol::RK_PATH)
+    {
+        res->messages = "ERROR: unknown request kind\n";
+        return res;
+    }
+    name = (displayname.empty() ? payload : displayname);
+    if(::stat(payload.c_str(), &before) == 0)
+    {
+        // the name goes in as well, since the messages contain it
+        key = (lrukey(payload, before, flags) + '\0' + name);
+        cached = m_lru.get(key);
+        if(cached != nullptr)
+        {
+            return cached;
+        }
+    }
+    {
+        MappedFile inmap;
+        if(!inmap.open(payload))
+        {
+            std::ostringstream msgs;
+            Util::sfprintf(msgs, RMCPP_FMT("ERROR: cannot open %q for reading\n"), name);
+            res->messages = msgs.str();
+            return res;
+        }
+        strip(flags, inmap.data(), inmap.size(), name, *res);
+    }
+    // only kept if the file didn't change while it was being read
+    if(!key.empty() && (::stat(payload.c_str(), &after) == 0) && samefile(before, after))
+    {
+        m_lru.put(key, res);
+    }
+    return res;
+}
+
+/*
+* reads one request from <fd>, and answers it.
+* @returns false if the connection is done for: the client hung up, sent something that
+* isn't a request (or one that's too large), or stalled halfway through one.
+*/
+bool StripServer::serve(int fd)
+{
+    uint32_t flags;
+    uint32_t kind;
+    uint64_t paylen;
+    uint64_t namelen;
+    uint64_t maxlen;
+    std::string payload;
+    std::string displayname;
+    unsigned char reqhdr[Protocol::requestheadersize];
+    unsigned char resphdr[Protocol::responseheadersize];
+    std::shared_ptr<const Result> res;
+    if(m_stopping || !Protocol::readall(fd, reqhdr, sizeof(reqhdr)))
+    {
+        return false;
+    }
+    if(Protocol::getle(reqhdr, 4) != Protocol::requestmagic)
+    {
+        // not a client; nothing sensible can be said to whoever this is
+        return false;
+    }
+    flags = uint32_t(Protocol::getle(reqhdr + 4, 4));
+    kind = uint32_t(Protocol::getle(reqhdr + 8, 4));
+    namelen = Protocol::getle(reqhdr + 12, 4);
+    paylen = Protocol::getle(reqhdr + 16, 8);
+    maxlen = ((kind == Protocol::RK_PATH) ? Protocol::maxpath : Protocol::maxinline);
+    if((paylen > maxlen) || (namelen > Protocol::maxpath))
+    {
+        return false;
+    }
+    payload.resize(paylen);
+    displayname.resize(namelen);
+    if(!Protocol::readall(fd, &payload[0], paylen) || !Protocol::readall(fd, &displayname[0], namelen))
+    {
+        return false;
+    }
+    res = process(flags, kind, payload, displayname);
+    Protocol::putle(resphdr, Protocol::responsemagic, 4);
+    Protocol::putle(resphdr + 4, res->status, 4);
+    Protocol::putle(resphdr + 8, res->output.size(), 8);
+    Protocol::putle(resphdr + 16, res->comments.size(), 8);
+    Protocol::putle(resphdr + 24, res->messages.size(), 8);
+    return (
+        Protocol::writeall(fd, resphdr, sizeof(resphdr)) &&
+        Protocol::writeall(fd, res->output.data(), res->output.size()) &&
+        Protocol::writeall(fd, res->comments.data(), res->comments.size()) &&
+        Protocol::writeall(fd, res->messages.data(), res->messages.size())
+    );
+}
+
+/*
+* accepts connections, and watches all of them (and m_wakefds) in one poll().
+* a connection with something to read is taken out, and queued for the workers - even
+* if it's only the client hanging up, which the worker then notices.
+*/
+bool StripServer::run()
+{
+    int rc;
+    int fd;
+    size_t i;
+    char drain[64];
+    struct timeval tv;
+    std::vector<int> conns;
+    std::vector<int> ready;
+    std::vector<struct pollfd> pfds;
+    std::vector<std::thread> threads;
+    if(!listen())
+    {
+        return false;
+    }
+    if(::pipe(m_wakefds) == -1)
+    {
+        Util::error(RMCPP_FMT("cannot create pipe: %s"), std::strerror(errno));
+        ::close(m_listenfd);
+        ::unlink(m_sockpath.c_str());
+        return false;
+    }
+    ::fcntl(m_wakefds[0], F_SETFL, O_NONBLOCK);
+    ::fcntl(m_wakefds[1], F_SETFL, O_NONBLOCK);
+    // a client that stalls halfway through a request only holds up its worker for so long
+    tv.tv_sec = requesttimeout;
+    tv.tv_usec = 0;
+    // a client that goes away mid-response is not a reason to die
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, oninterrupt);
+    std::signal(SIGTERM, oninterrupt);
+    for(i=0; i<m_nthreads; i++)
+    {
+        threads.emplace_back(&StripServer::work, this);
+    }
+    while(!g_interrupted)
+    {
+        pfds.clear();
+        pfds.push_back({m_listenfd, POLLIN, 0});
+        pfds.push_back({m_wakefds[0], POLLIN, 0});
+        for(int cfd: conns)
+        {
+            pfds.push_back({cfd, POLLIN, 0});
+        }
+        rc = ::poll(pfds.data(), pfds.size(), pollinterval);
+        if(rc <= 0)
+        {
+            continue;
+        }
+        // the ones with a request (or a hangup) go to the workers; the rest stay
+        ready.clear();
+        conns.clear();
+        for(i=2; i<pfds.size(); i++)
+        {
+            if(pfds[i].revents != 0)
+            {
+                ready.push_back(pfds[i].fd);
+            }
+            else
+            {
+                conns.push_back(pfds[i].fd);
+            }
+        }
+        if(!ready.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_queuemtx);
+                m_queue.insert(m_queue.end(), ready.begin(), ready.end());
+            }
+            m_queuecv.notify_all();
+        }
+        if(pfds[1].revents != 0)
+        {
+            while(::read(m_wakefds[0], drain, sizeof(drain)) > 0)
+            {
+            }
+            std::lock_guard<std::mutex> lock(m_queuemtx);
+            conns.insert(conns.end(), m_idle.begin(), m_idle.end());
+            m_idle.clear();
+        }
+        if(pfds[0].revents != 0)
+        {
+            fd = ::accept(m_listenfd, nullptr, nullptr);
+            if(fd != -1)
+            {
+                ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                conns.push_back(fd);
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queuemtx);
+        m_stopping = true;
+    }
+    m_queuecv.notify_all();
+    for(auto& th: threads)
+    {
+        th.join();
+    }
+    // connections nobody got around to, or that were idle
+    for(int qfd: m_queue)
+    {
+        ::close(qfd);
+    }
+    for(int qfd: m_idle)
+    {
+        ::close(qfd);
+    }
+    for(int cfd: conns)
+    {
+        ::close(cfd);
+    }
+    ::close(m_wakefds[0]);
+    ::close(m_wakefds[1]);
+    ::close(m_listenfd);
+    ::unlink(m_sockpath.c_str());
+    return true;
+}
+
+#endif
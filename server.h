@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "rmcpp.h"
+#include "protocol.h"
+
+/*
+* a long-lived rmcpp, answering strip requests on a unix domain socket (`rmcpp --serve`).
+*
+* starting a process, and setting up iostreams and the option parser takes longer
+* than stripping a typical source file; a build that runs rmcpp on thousands of
+* files is better off starting it once, and talking to it with the small client
+* (client.cpp, built as rmcppc).
+*
+* connections are accepted on the main thread, which also watches every open one.
+* once a request comes in, the connection is handed to a pool of workers; a worker
+* serves that one request, and hands the connection back. so a client that stays
+* connected without asking for anything doesn't hold up anyone else.
+* see protocol.h for the wire format.
+*
+* results for input files named by path are kept in memory, keyed by the path,
+* the file's modification time and size, and the options (see ResultLRU).
+*/
+class StripServer
+{
+    public:
+        // default size limit of the in-memory result cache
+        static constexpr uint64_t defaultlrusize = (uint64_t(64) * 1024 * 1024);
+
+        struct Result
+        {
+            Protocol::RespStatus status = Protocol::RS_ERROR;
+            std::string output;
+            std::string comments;
+            std::string messages;
+        };
+
+        /*
+        * recently served results, least recently used evicted first once the
+        * total size goes beyond the limit. shared by all workers.
+        */
+        class ResultLRU
+        {
+            private:
+                using Entry = std::pair<std::string, std::shared_ptr<const Result>>;
+
+            private:
+                std::mutex m_mtx;
+                std::list<Entry> m_order;
+                std::unordered_map<std::string, std::list<Entry>::iterator> m_map;
+                uint64_t m_maxsize;
+                uint64_t m_cursize;
+
+            private:
+                static uint64_t sizeof_result(const Result& res);
+
+            public:
+                ResultLRU(uint64_t maxsize);
+
+                /**
+                * @returns the result stored under <key>, or null.
+                */
+                std::shared_ptr<const Result> get(const std::string& key);
+
+                void put(const std::string& key, std::shared_ptr<const Result> res);
+        };
+
+    private:
+        std::string m_sockpath;
+        size_t m_nthreads;
+        int m_listenfd;
+        ResultLRU m_lru;
+
+        // connections with a request waiting, for the workers
+        std::mutex m_queuemtx;
+        std::condition_variable m_queuecv;
+        std::deque<int> m_queue;
+        // connections that were served, for run() to watch again
+        std::vector<int> m_idle;
+        // the workers write to the latter whenever they add to m_idle, so that run() notices
+        int m_wakefds[2];
+        std::atomic<bool> m_stopping;
+
+    private:
+        bool listen();
+        void work();
+        bool serve(int fd);
+        void strip(uint32_t flags, const char* data, size_t size, const std::string& infilename, Result& res);
+        std::shared_ptr<const Result> process(uint32_t flags, uint32_t kind, const std::string& payload, const std::string& displayname);
+
+    public:
+        /*
+        * <nthreads> of 0 means one thread per core.
+        * <lrusize> is in bytes; 0 disables the in-memory cache.
+        */
+        StripServer(const std::string& sockpath, size_t nthreads, uint64_t lrusize);
+
+        /**
+        * listens on the socket, and serves requests until interrupted (SIGINT, SIGTERM).
+        * the socket is removed again on the way out.
+        * @returns false (and complains) if the socket could not be set up.
+        */
+        bool run();
+
+        // the options for request <flags>, as the command line would have set them
+        static CommentStripper::Options makeoptions(uint32_t flags);
+};
@@ -0,0 +1,25 @@
+/*
+* SnippetStripper - see snippet.h
+*/
+
+#include "snippet.h"
+
+SnippetStripper::SnippetStripper(const CommentStripper::Options& opts):
+    m_cs(opts, nullptr, 0), m_target(nullptr), m_writer([this](const char* data, size_t size)
+    {
+        m_target->append(data, size);
+        return true;
+    })
+{
+}
+
+bool SnippetStripper::strip(std::string_view in, std::string& out)
+{
+    bool rc;
+    out.clear();
+    m_target = &out;
+    m_cs.reset(in.data(), in.size());
+    rc = m_cs.run(m_writer);
+    m_target = nullptr;
+    return rc;
+}
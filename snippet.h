@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "rmcpp.h"
+
+/*
+* strips in-memory snippets, one after the other, all with the same options.
+* this is what to use when embedding rmcpp: instead of wrapping every snippet in a
+* std::istream and setting up a new CommentStripper for it, one CommentStripper and
+* one SpanWriter are set up once, and only reset() in between. as long as the caller
+* reuses its output string as well, nothing is allocated anymore after the first few calls.
+*
+*   SnippetStripper ss(opts);
+*   std::string out;
+*   for(const auto& snippet: snippets)
+*   {
+*       ss.strip(snippet, out);
+*       // ...
+*   }
+*
+* not thread-safe; use one instance per thread.
+*/
+class SnippetStripper
+{
+    private:
+        CommentStripper m_cs;
+
+        // where m_writer appends to, for the duration of strip()
+        std::string* m_target;
+        SpanWriter m_writer;
+
+    public:
+        SnippetStripper(const CommentStripper::Options& opts);
+
+        SnippetStripper(const SnippetStripper&) = delete;
+        SnippetStripper& operator=(const SnippetStripper&) = delete;
+
+        /**
+        * strips <in> to <out>, replacing whatever <out> held before (but keeping its capacity).
+        * <in> is not copied; it only needs to stay valid until this returns.
+        * @returns true if no errors occured, false otherwise - just like CommentStripper::run().
+        */
+        bool strip(std::string_view in, std::string& out);
+
+        /*
+        * the CommentStripper doing the work, to set callbacks, a diagnostic stream, or stats.
+        * they stay in effect for every strip() after.
+        */
+        CommentStripper& stripper()
+        {
+            return m_cs;
+        }
+};
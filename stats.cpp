@@ -0,0 +1,106 @@
+/*
+* StripStats - see stats.h
+*/
+
+#include <cstdio>
+#include "stats.h"
+
+// JSON keys for the states that can actually be counted; the rest are never entered
+static const char* statename(size_t state)
+{
+    switch(state)
+    {
+        case CommentStripper::CT_UNDEF:
+            return "code";
+        case CommentStripper::CT_FWDSLASH:
+            return "fwdslash";
+        case CommentStripper::CT_CPPCOMM:
+            return "cpp";
+        case CommentStripper::CT_ANSICOMM:
+            return "ansi";
+        case CommentStripper::CT_PASCALCOMM:
+            return "pascal";
+        case CommentStripper::CT_HASHCOMM:
+            return "hash";
+        case CommentStripper::CT_LITERAL:
+            return "literal";
+        default:
+            break;
+    }
+    return nullptr;
+}
+
+static void putjsonstring(SpanWriter& out, const std::string& str)
+{
+    char buf[8];
+    out.put('"');
+    for(unsigned char ch: str)
+    {
+        if((ch == '"') || (ch == '\\'))
+        {
+            out.put('\\');
+            out.put(ch);
+        }
+        else if(ch < 0x20)
+        {
+            std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out.write(buf, 6);
+        }
+        else
+        {
+            out.put(ch);
+        }
+    }
+    out.put('"');
+}
+
+// writes the counters in <counts> that have a name, as a JSON object
+static void putcounts(SpanWriter& out, const uint64_t* counts, bool commentsonly)
+{
+    int len;
+    size_t i;
+    bool first;
+    char buf[64];
+    first = true;
+    out.put('{');
+    for(i=0; i<StripStats::nstates; i++)
+    {
+        if((statename(i) == nullptr) || (commentsonly && ((i == CommentStripper::CT_UNDEF) || (i == CommentStripper::CT_FWDSLASH) || (i == CommentStripper::CT_LITERAL))))
+        {
+            continue;
+        }
+        len = std::snprintf(buf, sizeof(buf), "%s\"%s\": %llu", (first ? "" : ", "), statename(i), (unsigned long long)counts[i]);
+        out.write(buf, len);
+        first = false;
+    }
+    out.put('}');
+}
+
+bool StripStats::writejson(SpanWriter& out, const std::string& infilename) const
+{
+    int len;
+    char buf[256];
+    uint64_t scanns;
+    scanns = ((runns > writens) ? (runns - writens) : 0);
+    out.write("{\"file\": ", 9);
+    putjsonstring(out, infilename);
+    len = std::snprintf(buf, sizeof(buf), ",\n \"bytes_in\": %llu, \"bytes_out\": %llu,\n \"comments\": ",
+        (unsigned long long)bytesin,
+        (unsigned long long)bytesout
+    );
+    out.write(buf, len);
+    putcounts(out, comments, true);
+    out.write(",\n \"state_bytes\": ", 18);
+    putcounts(out, statebytes, false);
+    len = std::snprintf(buf, sizeof(buf), ",\n \"max_pascal_nesting\": %llu, \"string_literals\": %llu, \"char_literals\": %llu,\n"
+        " \"time_ms\": {\"read\": %.3f, \"scan\": %.3f, \"write\": %.3f}}\n",
+        (unsigned long long)maxpascalnest,
+        (unsigned long long)strings,
+        (unsigned long long)chars,
+        (readns / 1e6),
+        (scanns / 1e6),
+        (writens / 1e6)
+    );
+    out.write(buf, len);
+    return out.flush();
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include "rmcpp.h"
+
+/*
+* counters for --stats: where the bytes go, and where the time goes.
+*
+* these are only compiled in if RMCPP_STATS is defined (see the Makefile).
+* otherwise RMCPP_STAT() expands to nothing, so the counting in the parser's
+* inner loop is gone altogether, rather than merely skipped.
+*/
+#if defined(RMCPP_STATS)
+    #define RMCPP_STAT(...) __VA_ARGS__
+#else
+    #define RMCPP_STAT(...)
+#endif
+
+struct StripStats
+{
+    #if defined(RMCPP_STATS)
+    static constexpr bool enabled = true;
+    #else
+    static constexpr bool enabled = false;
+    #endif
+
+    // one counter per CommentStripper::State
+    static constexpr size_t nstates = (CommentStripper::CT_LITERAL + 1);
+
+    /*
+    * adds the time from construction to destruction to <field> of <stats>.
+    * does nothing if <stats> is null.
+    */
+    class Timer
+    {
+        private:
+            uint64_t* m_dest;
+            uint64_t m_start;
+
+        public:
+            Timer(StripStats* stats, uint64_t StripStats::*field): m_dest(nullptr), m_start(0)
+            {
+                if(enabled && (stats != nullptr))
+                {
+                    m_dest = &(stats->*field);
+                    m_start = now();
+                }
+            }
+
+            ~Timer()
+            {
+                if(m_dest != nullptr)
+                {
+                    *m_dest += (now() - m_start);
+                }
+            }
+
+            Timer(const Timer&) = delete;
+            Timer& operator=(const Timer&) = delete;
+    };
+
+    // input read, output produced
+    uint64_t bytesin = 0;
+    uint64_t bytesout = 0;
+
+    // comments found, by kind (CT_CPPCOMM, CT_ANSICOMM, ...)
+    uint64_t comments[nstates] = {};
+
+    // bytes read in each state. carriage returns aren't counted, since more() skips them
+    uint64_t statebytes[nstates] = {};
+
+    // deepest nesting of pascal comments
+    uint64_t maxpascalnest = 0;
+
+    uint64_t strings = 0;
+    uint64_t chars = 0;
+
+    /*
+    * wall time, in nanoseconds: opening (mapping) the input, stripping it (everything
+    * up to the last flush, writing included), and writing the output.
+    * page faults on a mapped input land in <runns>, not <readns>.
+    */
+    uint64_t readns = 0;
+    uint64_t runns = 0;
+    uint64_t writens = 0;
+
+    // @returns a monotonic timestamp, in nanoseconds
+    static uint64_t now()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
+    }
+
+    /**
+    * writes everything as one JSON object to <out>.
+    * the scan time reported is <runns> minus <writens>.
+    * @returns false if writing failed.
+    */
+    bool writejson(SpanWriter& out, const std::string& infilename) const;
+};
@@ -0,0 +1,240 @@
+/*
+* strips files through the C interface (capi.h), the way rmcpp would: the output to stdout,
+* the messages to stderr, the removed comments to -o<file> (one per line), and the exit
+* status 1 if there were warnings. test/run.sh diffs all of it against test/expected.
+* several files are stripped one after the other with the same stripper, which must not
+* carry anything over from one to the next (see SnippetStripper).
+*
+*   capi [-p] [-l] [-a] [-c] [-s] [-w] [--convert-cpp] [--minify] [--minify-indent] [-o<file>] <file>...
+*
+* built by test/run.sh against librmcpp.a; this is plain C on purpose.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../capi.h"
+
+/* reads all of <path> into a malloc()ed buffer. @returns null on errors */
+static char* readfile(const char* path, size_t* len)
+{
+    size_t got;
+    size_t cap;
+    char* buf;
+    char* grown;
+    FILE* fp;
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+    {
+        return NULL;
+    }
+    *len = 0;
+    cap = 4096;
+    buf = (char*)malloc(cap);
+    while(buf != NULL)
+    {
+        got = fread(buf + *len, 1, cap - *len, fp);
+        *len += got;
+        if(*len < cap)
+        {
+            break;
+        }
+        cap *= 2;
+        grown = (char*)realloc(buf, cap);
+        if(grown == NULL)
+        {
+            free(buf);
+        }
+        buf = grown;
+    }
+    if((buf != NULL) && ferror(fp))
+    {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+static int writecomment(const rmcpp_comment* cm, void* userdata)
+{
+    FILE* fp;
+    fp = (FILE*)userdata;
+    fwrite(cm->text, 1, cm->length, fp);
+    fputc('\n', fp);
+    return 1;
+}
+
+/* @returns 0 if <arg> isn't an option */
+static int setoption(rmcpp_options* opts, const char* arg, const char** commpath)
+{
+    if(strcmp(arg, "-p") == 0)
+    {
+        opts->pascal = 1;
+    }
+    else if(strcmp(arg, "-l") == 0)
+    {
+        opts->hash = 1;
+    }
+    else if(strcmp(arg, "-a") == 0)
+    {
+        opts->keep_ansi = 1;
+    }
+    else if(strcmp(arg, "-c") == 0)
+    {
+        opts->keep_cpp = 1;
+    }
+    else if(strcmp(arg, "-s") == 0)
+    {
+        opts->strip_empty_lines = 1;
+    }
+    else if(strcmp(arg, "-w") == 0)
+    {
+        opts->warnings = 0;
+    }
+    else if(strcmp(arg, "--convert-cpp") == 0)
+    {
+        opts->convert_cpp = 1;
+    }
+    else if(strcmp(arg, "--minify") == 0)
+    {
+        opts->minify = 1;
+    }
+    else if(strcmp(arg, "--minify-indent") == 0)
+    {
+        opts->minify_indent = 1;
+    }
+    else if(strncmp(arg, "-o", 2) == 0)
+    {
+        *commpath = arg + 2;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+* strips <path> with <st>, writing the output and the messages.
+* @returns what rmcpp_strip() did, or 2 on errors.
+*/
+static int stripfile(rmcpp_stripper* st, const rmcpp_options* opts, const char* path)
+{
+    int rc;
+    int bufrc;
+    size_t inlen;
+    size_t buflen;
+    size_t outlen;
+    size_t msglen;
+    char* in;
+    char* buf;
+    const char* out;
+    const char* msgs;
+    in = readfile(path, &inlen);
+    if(in == NULL)
+    {
+        fprintf(stderr, "capi: cannot read '%s'\n", path);
+        return 2;
+    }
+    /* in one go, which has to come out the same as through the stripper */
+    bufrc = rmcpp_strip_buffer(opts, in, inlen, &buf, &buflen, NULL, NULL);
+    rc = rmcpp_strip(st, in, inlen, &out, &outlen);
+    if((rc < 0) || (bufrc < 0))
+    {
+        fprintf(stderr, "capi: stripping '%s' failed with %d\n", path, ((rc < 0) ? rc : bufrc));
+        rmcpp_free_buffer(buf);
+        free(in);
+        return 2;
+    }
+    fwrite(out, 1, outlen, stdout);
+    msgs = rmcpp_messages(st, &msglen);
+    fwrite(msgs, 1, msglen, stderr);
+    if((bufrc != rc) || (buflen != outlen) || (memcmp(buf, out, outlen) != 0))
+    {
+        fprintf(stderr, "capi: rmcpp_strip_buffer() and rmcpp_strip() differ for '%s'\n", path);
+        rc = 2;
+    }
+    rmcpp_free_buffer(buf);
+    free(in);
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+    int rc;
+    int frc;
+    int npaths;
+    const char* commpath;
+    FILE* commfp;
+    rmcpp_options opts;
+    rmcpp_stripper* st;
+    rc = 0;
+    npaths = 0;
+    commpath = NULL;
+    commfp = NULL;
+    rmcpp_options_init(&opts);
+    if(rmcpp_abi_version() != RMCPP_ABI_VERSION)
+    {
+        fprintf(stderr, "capi: built against ABI %d, linked against %d\n", RMCPP_ABI_VERSION, rmcpp_abi_version());
+        return 2;
+    }
+    for(i=1; i<argc; i++)
+    {
+        if(argv[i][0] != '-')
+        {
+            opts.filename = argv[i];
+            npaths++;
+        }
+        else if(!setoption(&opts, argv[i], &commpath))
+        {
+            fprintf(stderr, "capi: unknown option '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+    if(npaths == 0)
+    {
+        fprintf(stderr, "usage: capi [options] <file>...\n");
+        return 2;
+    }
+    if(npaths > 1)
+    {
+        /* one name for all of them would only be wrong */
+        opts.filename = NULL;
+    }
+    if(commpath != NULL)
+    {
+        commfp = fopen(commpath, "wb");
+        if(commfp == NULL)
+        {
+            fprintf(stderr, "capi: cannot open '%s' for writing\n", commpath);
+            return 2;
+        }
+    }
+    /* the messages only come from a stripper, and every file goes through this one */
+    st = rmcpp_new(&opts);
+    if(st == NULL)
+    {
+        fprintf(stderr, "capi: rmcpp_new() failed\n");
+        return 2;
+    }
+    if(commfp != NULL)
+    {
+        rmcpp_set_comment_callback(st, writecomment, commfp);
+    }
+    for(i=1; i<argc; i++)
+    {
+        if(argv[i][0] != '-')
+        {
+            frc = stripfile(st, &opts, argv[i]);
+            rc = ((frc > rc) ? frc : rc);
+        }
+    }
+    rmcpp_free(st);
+    if(commfp != NULL)
+    {
+        fclose(commfp);
+    }
+    return rc;
+}
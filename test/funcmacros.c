@@ -0,0 +1,18 @@
+/*
+* function-like macros (see test/funcmacros.defs)
+*/
+int a = MAX(x, y);
+int b = MAX(MAX(1, 2), (3, 4)); /* nested, and parentheses within an argument */
+int c = MAX (p,
+             q); // arguments across lines
+const char* s = STR(hello   world);
+const char* t = STR("quoted" 'c');
+int CAT(var, 12) = CAT(ONE, TWO);
+int d = SQUARE(ONE);
+LOG("fmt %d %d", 1, 2);
+LOG("no args");
+int MAX = 5; /* not followed by '(': left alone */
+int e = MAX;
+int f = TWICE(TWICE(2));
+int g = RECURSE(1);
+int h = NEG(g);
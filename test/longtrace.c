@@ -0,0 +1,602 @@
+/* more trace records than TraceRing keeps: the dump at the warning at the end drops the earliest */
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+a/**/'b'/**/c
+d = 'e
@@ -0,0 +1,28 @@
+/*
+* object-like macros, substituted after stripping (see test/macros.defs)
+*/
+#include <stdio.h>
+#define BUFSIZE 512 /* directive lines are left alone: BUFSIZE stays */
+#ifdef DEBUG
+#endif
+
+static char buffer[BUFSIZE]; // BUFSIZE in a comment is gone anyway
+static const char* name = "BUFSIZE stays in a string";
+static char quote = 'X';
+static int hex = 0xBUFSIZE;
+static double real = 1e10;
+
+int VERSION_MAJOR_x = VERSION_MAJOR; /* partial identifiers are not macros */
+int VERSION_MAJOR2 = VERSION_MINOR;
+int extra = EXTRA;
+
+int main(void)
+{
+    int n = BUFSIZE+BUFSIZE*(BUFSIZE);
+    if(DEBUG)
+    {
+        printf("%d.%d\n", VERSION_MAJOR, VERSION_MINOR);
+    }
+    /* rescanning: */ return CHAIN;
+    return SELF + EMPTY 0;
+}
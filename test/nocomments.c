@@ -0,0 +1,9 @@
+int main(void)
+{
+    const char* url = "http://example.com/*not a comment*/";
+    const char* path = "a/b/c";
+    char slash = '/';
+    int half = 10 / 2;
+    int ratio = half/slash;
+    return (url[0] + path[0] + half + ratio) * 0;
+}
@@ -0,0 +1,745 @@
+#!/bin/sh
+##
+# make test: strips the files in test/ with every option set below, and diffs the output,
+# messages and exit status against what's in test/expected.
+# every other way of getting the same result (threads, stdin, batch mode, the cache,
+# the server, ...) is diffed against the very same files, since none may differ.
+#
+#   test/run.sh            runs everything
+#   test/run.sh --update   rewrites test/expected from plain `rmcpp <options> <file>`,
+#                          after a change that is *meant* to change the output
+#
+# run from the top directory, after make. RMCPP, RMCPPC, CXX and CC override what is used.
+##
+
+RMCPP=${RMCPP:-./rmcpp.exe}
+RMCPPC=${RMCPPC:-./rmcppc.exe}
+# some cases run in other directories
+case $RMCPP in
+    /*) ;;
+    *) RMCPP="$(pwd)/$RMCPP" ;;
+esac
+CXX=${CXX:-g++}
+CC=${CC:-cc}
+expdir=test/expected
+update=0
+if [ "${1:-}" = "--update" ]; then
+    update=1
+    mkdir -p "$expdir"
+fi
+
+inputs="test/breaker.c test/edge.c test/funky.c test/test.c test/pastest.pas"
+
+# <tag>:<options>. the tag names the expected files
+optsets="
+plain:
+pascal:-p
+hash:-l
+keepansi:-a
+keepcpp:-c
+convertcpp:--convert-cpp
+pascalhash:-p -l
+nowarnings:-w
+strip:-s
+pascalstrip:-p -s
+minify:--minify
+minifyindent:--minify-indent
+pascalminify:-p --minify
+"
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/rmcpptest.XXXXXX") || exit 1
+trap 'rm -rf "$tmp"' EXIT INT TERM
+: > "$tmp/failed"
+
+fail()
+{
+    echo "FAIL: $*"
+    echo "$*" >> "$tmp/failed"
+}
+
+# same <what> <expected file> <actual file>
+same()
+{
+    if ! cmp -s "$2" "$3"; then
+        fail "$1"
+        diff "$2" "$3" | head -n 10
+    fi
+}
+
+# expected <input> <tag> <out|err>
+expected()
+{
+    echo "$expdir/$(basename "$1").$2.$3"
+}
+
+# runs "$@", with stdout in $tmp/out, and stderr plus the exit status in $tmp/err
+capture()
+{
+    "$@" > "$tmp/out" 2> "$tmp/err"
+    echo "exit: $?" >> "$tmp/err"
+}
+
+# calls <fn> <input> <tag> <options...> for every input and option set
+foreach()
+{
+    echo "$optsets" | while IFS=: read -r tag opts; do
+        [ -n "$tag" ] || continue
+        for f in $inputs; do
+            # shellcheck disable=SC2086
+            "$1" "$f" "$tag" $opts
+        done
+    done
+}
+
+# section <name> <fn>: runs <fn>, and says whether anything in it failed
+section()
+{
+    before=$(wc -l < "$tmp/failed")
+    "$2"
+    if [ "$(wc -l < "$tmp/failed")" = "$before" ]; then
+        echo "$1: ok"
+    else
+        echo "$1: FAILED"
+    fi
+}
+
+##
+# a named input file (read through a memory mapping), written to stdout.
+# this is what everything else is compared against.
+##
+plaincase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    capture "$RMCPP" "$@" "$f"
+    if [ $update = 1 ]; then
+        cp "$tmp/out" "$(expected "$f" "$tag" out)"
+        cp "$tmp/err" "$(expected "$f" "$tag" err)"
+        return
+    fi
+    same "$f [$*]" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+}
+
+plain()
+{
+    foreach plaincase
+}
+
+section plain plain
+
+##
+# the removed comments, written with -o (see CommentStripper::onCommentRange())
+##
+commentcase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    rm -f "$tmp/comm"
+    "$RMCPP" "$@" -o"$tmp/comm" "$f" > /dev/null 2>&1
+    if [ $update = 1 ]; then
+        cp "$tmp/comm" "$(expected "$f" "$tag" comm)"
+        return
+    fi
+    same "$f [$*] comments" "$(expected "$f" "$tag" comm)" "$tmp/comm"
+}
+
+comments()
+{
+    foreach commentcase
+}
+
+section comments comments
+
+##
+# --index-json. the index doesn't depend on much but the kinds of comments removed,
+# so two option sets cover it
+##
+indexcase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    case $tag in
+        plain|pascalhash) ;;
+        *) return ;;
+    esac
+    rm -f "$tmp/index.json"
+    "$RMCPP" "$@" --index-json="$tmp/index.json" "$f" > /dev/null 2>&1
+    if [ $update = 1 ]; then
+        cp "$tmp/index.json" "$(expected "$f" "$tag" index.json)"
+        return
+    fi
+    same "$f [$*] index" "$(expected "$f" "$tag" index.json)" "$tmp/index.json"
+}
+
+index()
+{
+    foreach indexcase
+}
+
+section index index
+
+##
+# the macro stage (-D, --define-file). test/macros.c has object-like macros, directives,
+# literals and numbers left alone, rescanning, and a macro that names itself;
+# test/funcmacros.c has function-like ones, with '#', '##' and __VA_ARGS__.
+##
+macrocase()
+{
+    f=$1
+    shift
+    capture "$RMCPP" "$@" "$f"
+    if [ $update = 1 ]; then
+        cp "$tmp/out" "$(expected "$f" defines out)"
+        cp "$tmp/err" "$(expected "$f" defines err)"
+        return
+    fi
+    same "$f" "$(expected "$f" defines out)" "$tmp/out"
+    same "$f messages" "$(expected "$f" defines err)" "$tmp/err"
+}
+
+macros()
+{
+    macrocase test/macros.c --define-file=test/macros.defs -DEXTRA=7
+    macrocase test/funcmacros.c --define-file=test/funcmacros.defs '-DNEG(x)=(-(x))'
+}
+
+section macros macros
+
+##
+# --stats-file and --stats (see StripStats). the times differ from run to run, so they're
+# left out; everything else is counted, and has to be the same every time.
+##
+statscase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    rm -f "$tmp/stats.json"
+    "$RMCPP" "$@" --stats-file="$tmp/stats.json" "$f" > /dev/null 2> "$tmp/err"
+    if grep -q 'not available in this build' "$tmp/err"; then
+        # built without RMCPP_STATS, which has to say so rather than write zeros
+        [ -e "$tmp/stats.json" ] && fail "$f [$*] --stats-file without RMCPP_STATS writes a file"
+        return
+    fi
+    grep -v '"time_ms"' "$tmp/stats.json" > "$tmp/stats"
+    # warnings go to stderr as well
+    "$RMCPP" "$@" --stats "$f" 2>&1 > /dev/null | grep -v -e '"time_ms"' -e '^WARNING: ' > "$tmp/stats.stderr"
+    if [ $update = 1 ]; then
+        cp "$tmp/stats" "$(expected "$f" "$tag" stats)"
+        return
+    fi
+    same "$f [$*] --stats-file" "$(expected "$f" "$tag" stats)" "$tmp/stats"
+    same "$f [$*] --stats" "$(expected "$f" "$tag" stats)" "$tmp/stats.stderr"
+}
+
+stats()
+{
+    statscase test/test.c plain
+    statscase test/pastest.pas pascal -p
+    if [ $update = 0 ]; then
+        "$RMCPP" --stats -O "$tmp/stats-out" test/test.c > /dev/null 2> "$tmp/err" && fail "--stats is accepted in batch mode"
+        grep -q -e 'can not be used in batch mode' -e 'not available in this build' "$tmp/err" || fail "--stats in batch mode: no error"
+    fi
+}
+
+section stats stats
+
+##
+# --debug: the trace ring (see TraceRing) is dumped on every warning and at the end.
+# funky.c ends in an unterminated literal; test/longtrace.c has more records before
+# its warning than the ring keeps, so the earliest are dropped. its dump is thousands
+# of lines, so only where it starts and ends is kept, and the records are counted.
+##
+tracecase()
+{
+    f=$1
+    shift
+    capture "$RMCPP" -d "$@" "$f"
+    if [ $update = 1 ]; then
+        cp "$tmp/err" "$(expected "$f" debug err)"
+        return
+    fi
+    same "$f [-d $*]" "$(expected "$f" debug err)" "$tmp/err"
+    same "$f [-d $*] output" "$(expected "$f" plain out)" "$tmp/out"
+}
+
+trace()
+{
+    tracecase test/funky.c
+    f=test/longtrace.c
+    capture "$RMCPP" -d "$f"
+    { head -n 3 "$tmp/err"; tail -n 16 "$tmp/err"; } > "$tmp/trace"
+    if [ $update = 1 ]; then
+        cp "$tmp/trace" "$(expected "$f" debug err)"
+        return
+    fi
+    same "$f [-d]" "$(expected "$f" debug err)" "$tmp/trace"
+    # TraceRing::defaultcapacity of them, after the line saying how many were dropped
+    n=$(grep -c "^>>>>\[$f:" "$tmp/err")
+    [ "$n" = 4096 ] || fail "$f [-d] dumps $n records, not 4096"
+}
+
+section trace trace
+if [ $update = 1 ]; then
+    echo "updated $expdir"
+    exit 0
+fi
+
+##
+# every scanning kernel (see scan.cpp), forced with RMCPP_SCAN. kernels the CPU doesn't
+# have fall back to the next best one, so this works anywhere.
+##
+kernelcase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    for k in scalar sse2 avx2 avx512; do
+        capture env RMCPP_SCAN=$k "$RMCPP" "$@" "$f"
+        same "$f [$*] RMCPP_SCAN=$k" "$(expected "$f" "$tag" out)" "$tmp/out"
+        same "$f [$*] RMCPP_SCAN=$k messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+    done
+}
+
+kernels()
+{
+    foreach kernelcase
+    # a typo is complained about, and ignored
+    env RMCPP_SCAN=avx-2 "$RMCPP" test/test.c > "$tmp/out" 2> "$tmp/err"
+    same "RMCPP_SCAN=avx-2" "$(expected test/test.c plain out)" "$tmp/out"
+    grep -q 'ignoring RMCPP_SCAN' "$tmp/err" || fail "RMCPP_SCAN=avx-2 isn't complained about"
+}
+
+section kernels kernels
+
+##
+# the parser with the option flags checked at runtime (Options::use_specialized off,
+# forced with RMCPP_GENERIC=1), which rmcppbench only times: it has to produce
+# exactly what the copies specialized for each option set do.
+##
+genericcase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    rm -f "$tmp/comm"
+    capture env RMCPP_GENERIC=1 "$RMCPP" "$@" -o"$tmp/comm" "$f"
+    same "$f [$*] RMCPP_GENERIC=1" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] RMCPP_GENERIC=1 messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+    same "$f [$*] RMCPP_GENERIC=1 comments" "$(expected "$f" "$tag" comm)" "$tmp/comm"
+}
+
+generic()
+{
+    foreach genericcase
+}
+
+section generic generic
+
+##
+# written to a named output file, rather than stdout (see SpanWriter)
+##
+outfilecase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    rm -f "$tmp/outfile"
+    capture "$RMCPP" "$@" "$f" "$tmp/outfile"
+    same "$f [$*] into a file" "$(expected "$f" "$tag" out)" "$tmp/outfile"
+    same "$f [$*] into a file, messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+}
+
+outfile()
+{
+    foreach outfilecase
+}
+
+section outfile outfile
+
+##
+# batch mode: all inputs at once, into an output directory, on several threads.
+# the messages come with a summary, so only the exit status is checked against them.
+##
+batchcase()
+{
+    tag=$1
+    shift
+    outdir="$tmp/batch-$tag"
+    rm -rf "$outdir"
+    "$@" -j3 -O "$outdir" $inputs > /dev/null 2>&1
+    rc=$?
+    want=0
+    for f in $inputs; do
+        same "$f [$tag] in batch mode ($*)" "$(expected "$f" "$tag" out)" "$outdir/$f"
+        grep -q '^exit: 0$' "$(expected "$f" "$tag" err)" || want=1
+    done
+    [ $rc = $want ] || fail "batch mode [$tag] ($*) exits with $rc, not $want"
+}
+
+# batchrun <command>: batchcase() for every option set
+batchrun()
+{
+    echo "$optsets" | while IFS=: read -r tag opts; do
+        [ -n "$tag" ] || continue
+        # shellcheck disable=SC2086
+        batchcase "$tag" "$@" $opts
+    done
+}
+
+batch()
+{
+    batchrun "$RMCPP"
+}
+
+section batch batch
+
+##
+# --threads. the inputs are too small to be split, so they only check that nothing
+# changes on the way; the big one (all inputs, over and over) is split into chunks that
+# end anywhere, and has to come out the same as it does on one thread.
+##
+threadcase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    capture "$RMCPP" -t4 "$@" "$f"
+    same "$f [$*] -t4" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] -t4 messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+}
+
+threads()
+{
+    foreach threadcase
+    : > "$tmp/big.c"
+    i=0
+    while [ $i -lt 400 ]; do
+        cat test/breaker.c test/edge.c test/test.c test/pastest.pas >> "$tmp/big.c"
+        i=$((i + 1))
+    done
+    # funky.c ends in an unterminated literal, which only works once, at the very end
+    cat test/funky.c >> "$tmp/big.c"
+    echo "$optsets" | while IFS=: read -r tag opts; do
+        [ -n "$tag" ] || continue
+        # shellcheck disable=SC2086
+        capture "$RMCPP" $opts "$tmp/big.c"
+        mv "$tmp/out" "$tmp/big.out"
+        mv "$tmp/err" "$tmp/big.err"
+        for n in 2 4 7; do
+            # shellcheck disable=SC2086
+            capture "$RMCPP" -t$n $opts "$tmp/big.c"
+            same "big input [$opts] -t$n" "$tmp/big.out" "$tmp/out"
+            same "big input [$opts] -t$n messages" "$tmp/big.err" "$tmp/err"
+        done
+    done
+}
+
+section threads threads
+
+##
+# --cache: the first run misses and stores, the second one is copied out of the cache.
+# results with warnings are never stored, so those miss every time.
+##
+cachecase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    cachedir="$tmp/cache-$tag"
+    capture "$RMCPP" --cache="$cachedir" "$@" "$f"
+    same "$f [$*] cache miss" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] cache miss, messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+    want="1 hits"
+    [ "$(cat "$(expected "$f" "$tag" err)")" = "exit: 0" ] || want="0 hits"
+    for dest in stdout file; do
+        rm -f "$tmp/outfile"
+        if [ $dest = stdout ]; then
+            "$RMCPP" --cache="$cachedir" --cache-stats "$@" "$f" > "$tmp/outfile" 2> "$tmp/err"
+        else
+            "$RMCPP" --cache="$cachedir" --cache-stats "$@" "$f" "$tmp/outfile" 2> "$tmp/err"
+        fi
+        same "$f [$*] cache hit, to $dest" "$(expected "$f" "$tag" out)" "$tmp/outfile"
+        grep -q "cache: $want" "$tmp/err" || fail "$f [$*] cache hit, to $dest: not '$want'"
+    done
+}
+
+cache()
+{
+    foreach cachecase
+    # entries stored without comments can't answer a run that wants them
+    f=test/test.c
+    "$RMCPP" --cache="$tmp/cache-comm" "$f" > /dev/null 2>&1
+    "$RMCPP" --cache="$tmp/cache-comm" --cache-stats -o"$tmp/comm" "$f" > "$tmp/out" 2> "$tmp/err"
+    grep -q "cache: 0 hits" "$tmp/err" || fail "$f cache hit without comments"
+    "$RMCPP" --cache="$tmp/cache-comm" --cache-stats -o"$tmp/comm" "$f" > "$tmp/out" 2> "$tmp/err"
+    grep -q "cache: 1 hits" "$tmp/err" || fail "$f cache hit with comments"
+    same "$f cache hit, comments" "$(expected "$f" plain comm)" "$tmp/comm"
+    same "$f cache hit with comments" "$(expected "$f" plain out)" "$tmp/out"
+    # a hit that can't be written out is an error, not a miss
+    if [ -w /dev/full ]; then
+        "$RMCPP" --cache="$tmp/cache-comm" "$f" > /dev/full 2> /dev/null && fail "$f cache hit into /dev/full succeeds"
+    fi
+    # an entry goes as a whole: the comments of one in use aren't evicted before its
+    # output, however old their file is. the filler is the least recently used entry,
+    # and evicting it is enough to get back under the 1MB limit
+    cachedir="$tmp/cache-evict"
+    : > "$tmp/filler1.c"
+    i=0
+    while [ $i -lt 500 ]; do
+        cat "$f" >> "$tmp/filler1.c"
+        i=$((i + 1))
+    done
+    { cat "$tmp/filler1.c"; echo "int x;"; } > "$tmp/filler2.c"
+    "$RMCPP" --cache="$cachedir" --cache-size=1 "$tmp/filler1.c" > /dev/null 2>&1
+    find "$cachedir" -type f -exec touch -t 202001010000 {} +
+    "$RMCPP" --cache="$cachedir" --cache-size=1 -o/dev/null "$f" > /dev/null 2>&1
+    find "$cachedir" -type f -name '*.comm' -exec touch -t 201901010000 {} +
+    "$RMCPP" --cache="$cachedir" --cache-size=1 "$tmp/filler2.c" > /dev/null 2>&1
+    "$RMCPP" --cache="$cachedir" --cache-size=1 --cache-stats -o"$tmp/comm" "$f" > "$tmp/out" 2> "$tmp/err"
+    grep -q "cache: 1 hits" "$tmp/err" || fail "$f evicted from the cache, or just its comments"
+    same "$f cache hit after evicting, comments" "$(expected "$f" plain comm)" "$tmp/comm"
+}
+
+section cache cache
+
+##
+# rmcppc, talking to rmcpp --serve: the same output, messages and exit status as rmcpp.
+# the server has a single worker, so a client that connects and then sits there
+# (where python3 is around to be one) must not hold up anyone else.
+##
+clientcase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    capture "$RMCPPC" "$sock" "$@" "$f"
+    same "$f [$*] rmcppc" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] rmcppc messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+    "$RMCPPC" "$sock" "$@" < "$f" > "$tmp/out" 2> /dev/null
+    same "$f [$*] rmcppc, stdin" "$(expected "$f" "$tag" out)" "$tmp/out"
+}
+
+server()
+{
+    sock="$tmp/rmcpp.sock"
+    "$RMCPP" --serve="$sock" -j1 2> "$tmp/server.err" &
+    serverpid=$!
+    i=0
+    while [ ! -S "$sock" ] && [ $i -lt 50 ]; do
+        sleep 0.1
+        i=$((i + 1))
+    done
+    idlepid=
+    if command -v python3 > /dev/null 2>&1; then
+        python3 -c 'import socket, sys, time; s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); time.sleep(60)' "$sock" &
+        idlepid=$!
+        sleep 0.2
+        "$RMCPPC" "$sock" test/test.c > /dev/null 2>&1 &
+        probepid=$!
+        i=0
+        while kill -0 $probepid 2> /dev/null && [ $i -lt 50 ]; do
+            sleep 0.1
+            i=$((i + 1))
+        done
+        if kill -0 $probepid 2> /dev/null; then
+            fail "rmcppc is held up by an idle connection"
+            kill $probepid
+        fi
+    fi
+    foreach clientcase
+    capture "$RMCPPC" "$sock" test/nonexistent.c
+    "$RMCPP" test/nonexistent.c > /dev/null 2> "$tmp/want.err"
+    echo "exit: 1" >> "$tmp/want.err"
+    same "rmcppc, missing input" "$tmp/want.err" "$tmp/err"
+    [ -n "$idlepid" ] && kill $idlepid 2> /dev/null
+    kill $serverpid
+    wait $serverpid 2> /dev/null
+    same "rmcpp --serve messages" /dev/null "$tmp/server.err"
+}
+
+section server server
+
+##
+# the macro stage is fed the stripped output piece by piece, as it's flushed, so
+# identifiers get split between pieces. test/macros.c over and over (2MB) has to come
+# out as its expected output over and over - from a file, on threads, and from stdin.
+##
+macrostream()
+{
+    : > "$tmp/bigmacros.c"
+    : > "$tmp/bigmacros.want"
+    i=0
+    while [ $i -lt 3000 ]; do
+        cat test/macros.c >> "$tmp/bigmacros.c"
+        cat "$(expected test/macros.c defines out)" >> "$tmp/bigmacros.want"
+        i=$((i + 1))
+    done
+    for t in -t1 -t4; do
+        "$RMCPP" $t --define-file=test/macros.defs -DEXTRA=7 "$tmp/bigmacros.c" > "$tmp/out" 2> /dev/null
+        same "big macro input $t" "$tmp/bigmacros.want" "$tmp/out"
+    done
+    "$RMCPP" --define-file=test/macros.defs -DEXTRA=7 < "$tmp/bigmacros.c" > "$tmp/out" 2> /dev/null
+    same "big macro input, stdin" "$tmp/bigmacros.want" "$tmp/out"
+}
+
+section macrostream macrostream
+
+##
+# batch mode again, with the read-ahead and write-behind on the fallback thread rather
+# than io_uring (where the batch section above used that), and with enough files to
+# keep more requests in flight than the ring has entries
+##
+manyfiles()
+{
+    rm -rf "$tmp/many" "$tmp/many-out"
+    i=0
+    while [ $i -lt 20 ]; do
+        mkdir -p "$tmp/many/$i"
+        for f in $inputs; do
+            cp "$f" "$tmp/many/$i/"
+        done
+        i=$((i + 1))
+    done
+    (cd "$tmp/many" && "$@" -j2 -O ../many-out */*) > /dev/null 2>&1
+    i=0
+    while [ $i -lt 20 ]; do
+        for f in $inputs; do
+            same "$f copy $i in batch mode ($*)" "$(expected "$f" plain out)" "$tmp/many-out/$i/$(basename "$f")"
+        done
+        i=$((i + 1))
+    done
+}
+
+asyncio()
+{
+    batchrun env RMCPP_IO=thread "$RMCPP"
+    manyfiles env RMCPP_IO=thread "$RMCPP"
+    manyfiles "$RMCPP"
+}
+
+section asyncio asyncio
+
+##
+# standard input, read in blocks (see StreamInput). messages name the input "<stdin>",
+# which is the only difference allowed. the big input from the threads section, piped
+# through cat, crosses every kind of state at a block boundary somewhere.
+##
+stdincase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    "$RMCPP" "$@" < "$f" > "$tmp/out" 2> "$tmp/err"
+    echo "exit: $?" >> "$tmp/err"
+    sed "s|\[<stdin>:|[$f:|" "$tmp/err" > "$tmp/err.named"
+    same "$f [$*] stdin" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] stdin messages" "$(expected "$f" "$tag" err)" "$tmp/err.named"
+}
+
+stdin()
+{
+    foreach stdincase
+    echo "$optsets" | while IFS=: read -r tag opts; do
+        [ -n "$tag" ] || continue
+        # shellcheck disable=SC2086
+        capture "$RMCPP" $opts "$tmp/big.c"
+        mv "$tmp/out" "$tmp/big.out"
+        # shellcheck disable=SC2086
+        cat "$tmp/big.c" | "$RMCPP" $opts > "$tmp/out" 2> /dev/null
+        same "big input [$opts] through a pipe" "$tmp/big.out" "$tmp/out"
+    done
+}
+
+section stdin stdin
+
+##
+# files without anything to strip are copied as-is (see CommentStripper::isverbatim()),
+# by the kernel where possible. test/nocomments.c has slashes and "/*" in literals,
+# but no comments, so it has to come out unchanged: to a pipe, a file, and in batch
+# mode. the same with one comment at the very end, or with CRLF line endings, must
+# not be copied as-is.
+##
+verbatim()
+{
+    f=test/nocomments.c
+    for opts in "" -l -a -c; do
+        # shellcheck disable=SC2086
+        "$RMCPP" $opts "$f" | cat > "$tmp/out"
+        same "$f [$opts] to a pipe" "$f" "$tmp/out"
+        rm -f "$tmp/outfile"
+        # shellcheck disable=SC2086
+        "$RMCPP" $opts "$f" "$tmp/outfile"
+        same "$f [$opts] to a file" "$f" "$tmp/outfile"
+    done
+    rm -rf "$tmp/verbatim-out"
+    "$RMCPP" -O "$tmp/verbatim-out" "$f" > /dev/null
+    same "$f in batch mode" "$f" "$tmp/verbatim-out/$f"
+    { cat "$f"; echo "/* the end */"; } > "$tmp/lastcomment.c"
+    { cat "$f"; echo; } > "$tmp/lastcomment.want"
+    "$RMCPP" "$tmp/lastcomment.c" > "$tmp/out"
+    same "$f with a comment at the end" "$tmp/lastcomment.want" "$tmp/out"
+    sed 's/$/\r/' "$f" > "$tmp/crlf.c"
+    "$RMCPP" "$tmp/crlf.c" > "$tmp/out"
+    same "$f with CRLF line endings" "$f" "$tmp/out"
+}
+
+section verbatim verbatim
+
+##
+# the C interface (capi.h), through test/capi.c linked against librmcpp.a: the output,
+# messages, exit status and comments have to be the same as rmcpp's. the stripper
+# (a SnippetStripper underneath) is reused for every input as well.
+##
+capicase()
+{
+    f=$1
+    tag=$2
+    shift 2
+    rm -f "$tmp/comm"
+    capture "$tmp/capi" "$@" -o"$tmp/comm" "$f"
+    same "$f [$*] C interface" "$(expected "$f" "$tag" out)" "$tmp/out"
+    same "$f [$*] C interface messages" "$(expected "$f" "$tag" err)" "$tmp/err"
+    same "$f [$*] C interface comments" "$(expected "$f" "$tag" comm)" "$tmp/comm"
+}
+
+capi()
+{
+    if ! "$CC" -std=c99 -Wall -Wextra -pedantic test/capi.c librmcpp.a -lstdc++ -lm -pthread -o "$tmp/capi"; then
+        fail "test/capi.c doesn't build against librmcpp.a"
+        return
+    fi
+    foreach capicase
+    # every input, twice over, through one stripper: nothing may carry over from one to
+    # the next - funky.c ends inside a literal, and test.c comes right after it
+    echo "$optsets" | while IFS=: read -r tag opts; do
+        [ -n "$tag" ] || continue
+        : > "$tmp/reuse.out"
+        : > "$tmp/reuse.comm"
+        want=0
+        for f in $inputs $inputs; do
+            cat "$(expected "$f" "$tag" out)" >> "$tmp/reuse.out"
+            cat "$(expected "$f" "$tag" comm)" >> "$tmp/reuse.comm"
+            grep -q '^exit: 0$' "$(expected "$f" "$tag" err)" || want=1
+        done
+        rm -f "$tmp/comm"
+        # shellcheck disable=SC2086
+        "$tmp/capi" $opts -o"$tmp/comm" $inputs $inputs > "$tmp/out" 2> /dev/null
+        rc=$?
+        same "all inputs [$opts] through one stripper" "$tmp/reuse.out" "$tmp/out"
+        same "all inputs [$opts] through one stripper, comments" "$tmp/reuse.comm" "$tmp/comm"
+        [ $rc = $want ] || fail "all inputs [$opts] through one stripper exits with $rc, not $want"
+    done
+}
+
+section capi capi
+
+if [ -s "$tmp/failed" ]; then
+    echo "$(wc -l < "$tmp/failed") test(s) FAILED"
+    exit 1
+fi
+echo "all tests passed"
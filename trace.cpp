@@ -0,0 +1,71 @@
+/*
+* TraceRing - see trace.h
+*/
+
+#include "trace.h"
+
+TraceRing::TraceRing(): m_head(0), m_tail(0)
+{
+}
+
+void TraceRing::enable(size_t capacity)
+{
+    size_t size;
+    size = 1;
+    while(size < capacity)
+    {
+        size <<= 1;
+    }
+    m_records.assign(size, Record());
+    m_head = 0;
+    m_tail = 0;
+}
+
+void TraceRing::dump(std::ostream& out, const std::string& infilename)
+{
+    uint64_t i;
+    if(m_records.empty() || (m_head == m_tail))
+    {
+        return;
+    }
+    if((m_head - m_tail) > m_records.size())
+    {
+        out << ">>>>[" << infilename << "]: (" << ((m_head - m_tail) - m_records.size()) << " earlier records dropped)" << std::endl;
+        m_tail = (m_head - m_records.size());
+    }
+    for(i=m_tail; i<m_head; i++)
+    {
+        const Record& rec = m_records[i & (m_records.size() - 1)];
+        out << ">>>>[" << infilename << ":" << rec.line << " @" << rec.offset << "]: ";
+        switch(rec.kind)
+        {
+            case TR_BYTE:
+                out << "in " << CommentStripper::statename(CommentStripper::State(rec.state)) << ": currch='";
+                Util::escapechar(out, rec.byte);
+                out << "'";
+                break;
+            case TR_STATE:
+                out
+                    << CommentStripper::statename(CommentStripper::State(rec.state))
+                    << " -> "
+                    << CommentStripper::statename(CommentStripper::State(rec.nextstate))
+                ;
+                break;
+            case TR_SKIP:
+                out << "skipped " << rec.aux << " bytes in " << CommentStripper::statename(CommentStripper::State(rec.state));
+                break;
+            case TR_NEST:
+                out << "in pascalcomment: nesting up to level " << rec.aux;
+                break;
+            case TR_UNNEST:
+                out << "in pascalcomment: unnesting from level " << rec.aux;
+                break;
+            default:
+                out << "(bad record)";
+                break;
+        }
+        out << '\n';
+    }
+    out.flush();
+    m_tail = m_head;
+}
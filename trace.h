@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "rmcpp.h"
+
+/*
+* what --debug records: a fixed-size ring of compact binary records, rather than
+* a formatted line per byte.
+*
+* recording is a handful of stores; nothing is formatted until the ring is dumped,
+* which CommentStripper does whenever a warning fires, and once it's done.
+* only the last <capacity> records are kept, so tracing costs next to nothing,
+* and a dump shows what led up to a warning, rather than everything since the start.
+*/
+class TraceRing
+{
+    public:
+        enum Kind : uint8_t
+        {
+            // a byte, handled one at a time. only recorded inside of comments
+            TR_BYTE,
+            // the parser went from <state> to <nextstate>
+            TR_STATE,
+            // <aux> bytes were skipped over in one go
+            TR_SKIP,
+            // pascal comment nesting went up to, or down from, <aux>
+            TR_NEST,
+            TR_UNNEST,
+        };
+
+        struct Record
+        {
+            // offset of the byte in the input. for TR_SKIP, the first byte skipped
+            uint64_t offset;
+            uint32_t line;
+            uint32_t aux;
+            uint8_t kind;
+            uint8_t state;
+            uint8_t nextstate;
+            uint8_t byte;
+        };
+
+        static constexpr size_t defaultcapacity = 4096;
+
+    private:
+        // a power of two in size; empty while disabled
+        std::vector<Record> m_records;
+
+        // records pushed so far, and the first not dumped yet
+        uint64_t m_head;
+        uint64_t m_tail;
+
+    public:
+        TraceRing();
+
+        // starts recording, keeping the last <capacity> records (rounded up to a power of two)
+        void enable(size_t capacity=defaultcapacity);
+
+        bool enabled() const
+        {
+            return !m_records.empty();
+        }
+
+        // only valid if enabled
+        void push(const Record& rec)
+        {
+            m_records[m_head & (m_records.size() - 1)] = rec;
+            m_head++;
+        }
+
+        /*
+        * decodes everything recorded since the last dump, oldest first, one line per record,
+        * and forgets it. records that were overwritten before they could be dumped are counted.
+        */
+        void dump(std::ostream& out, const std::string& infilename);
+};
@@ -0,0 +1,438 @@
+/*
+* SpanWriter - see rmcpp.h
+*/
+
+#include <cstring>
+#include <cerrno>
+#include <new>
+#if defined(_WIN32)
+    #include <io.h>
+    #include <fcntl.h>
+#else
+    #include <sys/uio.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#if defined(__linux__)
+    #include <sys/ioctl.h>
+    #include <sys/sendfile.h>
+    #include <linux/fs.h>
+#endif
+#include "rmcpp.h"
+#include "stats.h"
+
+// the copy buffer is page-aligned, which keeps the kernel happy when copying out of it
+static constexpr std::align_val_t bufferalign = std::align_val_t(4096);
+
+SpanWriter::SpanWriter(): m_fd(1), m_ownsfd(false), m_outfp(nullptr), m_outstr(nullptr)
+{
+    init();
+}
+
+SpanWriter::SpanWriter(int fd): m_fd(fd), m_ownsfd(false), m_outfp(nullptr), m_outstr(nullptr)
+{
+    init();
+}
+
+SpanWriter::SpanWriter(std::ostream& outfp): m_fd(-1), m_ownsfd(false), m_outfp(&outfp), m_outstr(nullptr)
+{
+    init();
+}
+
+SpanWriter::SpanWriter(std::string& outstr): m_fd(-1), m_ownsfd(false), m_outfp(nullptr), m_outstr(&outstr)
+{
+    init();
+}
+
+SpanWriter::SpanWriter(ChunkFunc fn): m_fd(-1), m_ownsfd(false), m_outfp(nullptr), m_outstr(nullptr), m_outfn(fn)
+{
+    init();
+}
+
+SpanWriter::~SpanWriter()
+{
+    flush();
+    if(m_ownsfd)
+    {
+        #if defined(_WIN32)
+        _close(m_fd);
+        #else
+        close(m_fd);
+        #endif
+    }
+    ::operator delete(m_buf, bufferalign);
+}
+
+void SpanWriter::init()
+{
+    m_buf = (char*)::operator new(buffersize, bufferalign);
+    m_buflen = 0;
+    m_bufmark = 0;
+    m_npieces = 0;
+    m_flushed = 0;
+    m_good = true;
+    m_stats = nullptr;
+}
+
+bool SpanWriter::open(const std::string& path)
+{
+    int fd;
+    flush();
+    #if defined(_WIN32)
+    fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+    #else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    #endif
+    if(fd == -1)
+    {
+        return false;
+    }
+    if(m_ownsfd)
+    {
+        #if defined(_WIN32)
+        _close(m_fd);
+        #else
+        close(m_fd);
+        #endif
+    }
+    m_fd = fd;
+    m_ownsfd = true;
+    m_outfp = nullptr;
+    m_outstr = nullptr;
+    m_outfn = nullptr;
+    m_good = true;
+    return true;
+}
+
+void SpanWriter::seal()
+{
+    if(m_buflen > m_bufmark)
+    {
+        addpiece(m_buf + m_bufmark, m_buflen - m_bufmark);
+        m_bufmark = m_buflen;
+    }
+}
+
+void SpanWriter::addpiece(const char* data, size_t size)
+{
+    Piece* last;
+    if(m_npieces > 0)
+    {
+        // contiguous with the previous piece? then just extend that one
+        last = &m_pieces[m_npieces - 1];
+        if((last->data + last->size) == data)
+        {
+            last->size += size;
+            return;
+        }
+    }
+    if(m_npieces == maxpieces)
+    {
+        // the copy buffer stays as it is; only the pieces are written
+        writepieces();
+    }
+    m_pieces[m_npieces].data = data;
+    m_pieces[m_npieces].size = size;
+    m_npieces++;
+}
+
+bool SpanWriter::writepieces()
+{
+    size_t i;
+    RMCPP_STAT(StripStats::Timer timer(m_stats, &StripStats::writens);)
+    for(i=0; i<m_npieces; i++)
+    {
+        m_flushed += m_pieces[i].size;
+    }
+    if(m_good)
+    {
+        if(m_outstr != nullptr)
+        {
+            for(i=0; i<m_npieces; i++)
+            {
+                m_outstr->append(m_pieces[i].data, m_pieces[i].size);
+            }
+        }
+        else if(m_outfn)
+        {
+            for(i=0; (i<m_npieces) && m_good; i++)
+            {
+                m_good = m_outfn(m_pieces[i].data, m_pieces[i].size);
+            }
+        }
+        else if(m_fd == -1)
+        {
+            for(i=0; i<m_npieces; i++)
+            {
+                m_outfp->write(m_pieces[i].data, m_pieces[i].size);
+            }
+            m_good = m_outfp->good();
+        }
+        else
+        {
+            #if defined(_WIN32)
+            for(i=0; (i<m_npieces) && m_good; i++)
+            {
+                if(_write(m_fd, m_pieces[i].data, unsigned(m_pieces[i].size)) != int(m_pieces[i].size))
+                {
+                    m_good = false;
+                }
+            }
+            #else
+            size_t first;
+            ssize_t rc;
+            struct iovec iov[maxpieces];
+            for(i=0; i<m_npieces; i++)
+            {
+                iov[i].iov_base = (void*)m_pieces[i].data;
+                iov[i].iov_len = m_pieces[i].size;
+            }
+            first = 0;
+            while(first < m_npieces)
+            {
+                rc = writev(m_fd, iov + first, int(m_npieces - first));
+                if(rc == -1)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    m_good = false;
+                    break;
+                }
+                // partial writes: skip what was written, and go again
+                while((first < m_npieces) && (size_t(rc) >= iov[first].iov_len))
+                {
+                    rc -= iov[first].iov_len;
+                    first++;
+                }
+                if(first < m_npieces)
+                {
+                    iov[first].iov_base = (char*)iov[first].iov_base + rc;
+                    iov[first].iov_len -= rc;
+                }
+            }
+            #endif
+        }
+    }
+    m_npieces = 0;
+    return m_good;
+}
+
+void SpanWriter::writelarge(const char* data, size_t size)
+{
+    size_t room;
+    while(size > 0)
+    {
+        if(m_buflen == buffersize)
+        {
+            flush();
+        }
+        room = std::min(buffersize - m_buflen, size);
+        std::memcpy(m_buf + m_buflen, data, room);
+        m_buflen += room;
+        data += room;
+        size -= room;
+    }
+}
+
+bool SpanWriter::flush()
+{
+    seal();
+    writepieces();
+    m_buflen = 0;
+    m_bufmark = 0;
+    return m_good;
+}
+
+size_t SpanWriter::tell() const
+{
+    size_t i;
+    size_t total;
+    total = m_flushed + (m_buflen - m_bufmark);
+    for(i=0; i<m_npieces; i++)
+    {
+        total += m_pieces[i].size;
+    }
+    return total;
+}
+
+void SpanWriter::setStats(StripStats* stats)
+{
+    m_stats = stats;
+}
+
+bool SpanWriter::copyfrom(int srcfd, size_t size)
+{
+    size_t done;
+    size_t want;
+    long rc;
+    if(!flush())
+    {
+        return false;
+    }
+    done = 0;
+    #if defined(__linux__)
+    if(m_fd != -1)
+    {
+        /*
+        * a freshly opened file can simply share the source's blocks, on
+        * filesystems that support it (btrfs, xfs, ...) - nothing is copied at all.
+        */
+        if(m_ownsfd && (m_flushed == 0) && (ioctl(m_fd, FICLONE, srcfd) == 0))
+        {
+            lseek(m_fd, size, SEEK_SET);
+            m_flushed += size;
+            return true;
+        }
+        // otherwise, let the kernel do the copying. fails for pipes, ttys, and so on
+        {
+            loff_t srcoff;
+            off_t sendoff;
+            srcoff = 0;
+            while(done < size)
+            {
+                rc = copy_file_range(srcfd, &srcoff, m_fd, nullptr, size - done, 0);
+                if(rc == -1)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+                if(rc == 0)
+                {
+                    break;
+                }
+                done += rc;
+            }
+            // sendfile() can write to pipes and sockets, too (i.e., stdout piped elsewhere)
+            while(done < size)
+            {
+                sendoff = off_t(done);
+                rc = sendfile(m_fd, srcfd, &sendoff, size - done);
+                if(rc == -1)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+                if(rc == 0)
+                {
+                    break;
+                }
+                done += rc;
+            }
+            m_flushed += done;
+        }
+    }
+    #endif
+    // whatever is left goes through the copy buffer
+    while(done < size)
+    {
+        want = std::min(buffersize, size - done);
+        #if defined(_WIN32)
+        _lseeki64(srcfd, done, SEEK_SET);
+        rc = _read(srcfd, m_buf, unsigned(want));
+        #else
+        rc = pread(srcfd, m_buf, want, done);
+        #endif
+        if(rc == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            m_good = false;
+            return false;
+        }
+        if(rc == 0)
+        {
+            // the source is shorter than it claimed to be
+            m_good = false;
+            return false;
+        }
+        m_buflen = rc;
+        done += rc;
+        flush();
+    }
+    return m_good;
+}
+
+BlankLineFilter::BlankLineFilter(): m_blank(true)
+{
+    m_findfn = Scan::findfunc();
+    m_skipfn = Scan::skipfunc();
+    // the stripper never lets '\r' through, but other writers might
+    m_space.add(' ');
+    m_space.add('\t');
+    m_space.add('\r');
+    m_space.add('\v');
+    m_space.add('\f');
+    m_newline.add('\n');
+}
+
+bool BlankLineFilter::feed(const char* data, size_t size, SpanWriter& out)
+{
+    const char* cur;
+    const char* end;
+    const char* stop;
+    const char* keep;
+    cur = data;
+    end = (data + size);
+    // everything from <keep> up to <cur> is written in one go, once a blank line interrupts it
+    keep = data;
+    while(cur < end)
+    {
+        if(m_blank)
+        {
+            // most lines start with something other than whitespace; no need for a kernel then
+            stop = cur;
+            if(m_space.table[(unsigned char)*cur])
+            {
+                stop = m_skipfn(cur, end, m_space);
+            }
+            if(stop == end)
+            {
+                // the line may yet turn out to be blank
+                out.write(keep, cur - keep);
+                m_pending.append(cur, stop - cur);
+                return out.good();
+            }
+            if(*stop == '\n')
+            {
+                // it is: gone, newline and all
+                out.write(keep, cur - keep);
+                m_pending.clear();
+                cur = (stop + 1);
+                keep = cur;
+                continue;
+            }
+            // it isn't, so whatever was held back goes out after all (<keep> is still <data> then)
+            if(!m_pending.empty())
+            {
+                out.write(m_pending.data(), m_pending.size());
+                m_pending.clear();
+            }
+            m_blank = false;
+        }
+        stop = m_findfn(cur, end, m_newline);
+        if(stop == end)
+        {
+            break;
+        }
+        cur = (stop + 1);
+        m_blank = true;
+    }
+    out.write(keep, end - keep);
+    return out.good();
+}
+
+void BlankLineFilter::finish()
+{
+    m_pending.clear();
+    m_blank = true;
+}